@@ -0,0 +1,136 @@
+/* arith.c - integer arithmetic for smsh
+ *
+ *    arith_eval( expr, &value )   evaluate expr as a 64 bit integer
+ *
+ *  this is what a declare -i variable is given when it is assigned:
+ *  decimal numbers, variable names, + - * / % with the usual weights,
+ *  unary - and +, and parentheses. A name stands for its value; an
+ *  integer variable hands over its number without going through a
+ *  string, and any other is read as a number, or 0 if it is not one.
+ *  Sums and products wrap around as in two's complement.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<ctype.h>
+#include	<stdint.h>
+
+#include	"varlib.h"
+#include	"arith.h"
+
+struct scan {
+	char	*p;			/* the next char		*/
+	char	*err;			/* message, NULL while all ok	*/
+};
+
+static int64_t	sum(struct scan *);
+
+static void blanks(struct scan *sp)
+{
+	while ( *sp->p == ' ' || *sp->p == '\t' )
+		sp->p++;
+}
+
+static int64_t primary(struct scan *sp)
+/*
+ * a number, a name, (sum), or a sign before any of them
+ */
+{
+	int64_t	v = 0;
+	char	*start;
+
+	blanks(sp);
+	start = sp->p;
+	if ( *sp->p == '-' || *sp->p == '+' ) {
+		sp->p++;
+		v = primary(sp);
+		return ( *start == '-' ? (int64_t)(0 - (uint64_t) v) : v );
+	}
+	if ( *sp->p == '(' ) {
+		sp->p++;
+		v = sum(sp);
+		blanks(sp);
+		if ( *sp->p != ')' && sp->err == NULL )
+			sp->err = "missing )";
+		else
+			sp->p++;
+		return v;
+	}
+	if ( isdigit((unsigned char) *sp->p) ) {
+		while ( isdigit((unsigned char) *sp->p) )
+			v = (int64_t)((uint64_t) v * 10 + (*sp->p++ - '0'));
+		return v;
+	}
+	while ( isalnum((unsigned char) *sp->p) || *sp->p == '_' )
+		sp->p++;
+	if ( sp->p == start ) {
+		if ( sp->err == NULL )
+			sp->err = "operand expected";
+		return 0;
+	}
+	VLgetint(start, sp->p - start, &v);
+	return v;
+}
+
+static int64_t product(struct scan *sp)
+{
+	int64_t	v = primary(sp), r;
+	char	op;
+
+	for ( blanks(sp) ; *sp->p == '*' || *sp->p == '/' || *sp->p == '%' ;
+								blanks(sp) ) {
+		op = *sp->p++;
+		r = primary(sp);
+		if ( op == '*' )
+			v = (int64_t)((uint64_t) v * (uint64_t) r);
+		else if ( r == 0 ) {
+			if ( sp->err == NULL )
+				sp->err = "division by 0";
+			return 0;
+		}
+		else if ( r == -1 )		/* INT64_MIN / -1 traps	*/
+			v = ( op == '/' ? (int64_t)(0 - (uint64_t) v) : 0 );
+		else
+			v = ( op == '/' ? v / r : v % r );
+	}
+	return v;
+}
+
+static int64_t sum(struct scan *sp)
+{
+	int64_t	v = product(sp), r;
+	char	op;
+
+	for ( blanks(sp) ; *sp->p == '+' || *sp->p == '-' ; blanks(sp) ) {
+		op = *sp->p++;
+		r = product(sp);
+		v = (int64_t)( op == '+' ? (uint64_t) v + (uint64_t) r
+					 : (uint64_t) v - (uint64_t) r );
+	}
+	return v;
+}
+
+int arith_eval(char *expr, int64_t *vp)
+/*
+ * purpose: evaluate an arithmetic expression
+ * returns: 0 with the result in *vp, 1 after a message for an error.
+ *          An empty expression is 0.
+ */
+{
+	struct scan s = { expr, NULL };
+	int64_t	v = 0;
+
+	blanks(&s);
+	if ( *s.p != '\0' ) {
+		v = sum(&s);
+		if ( *s.p != '\0' && s.err == NULL )
+			s.err = "syntax error";
+	}
+	if ( s.err != NULL ) {
+		fprintf(stderr, "smsh: %s: %s\n", expr, s.err);
+		return 1;
+	}
+	*vp = v;
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef	ARITH_H
+#define	ARITH_H
+/*
+ * header for arith.c - integer arithmetic
+ */
+#include	<stdint.h>
+
+int	arith_eval(char *, int64_t *);
+
+#endif
@@ -0,0 +1,167 @@
+/* bench_scan.c - how fast scan_any goes through a line
+ *
+ *    make bench      builds this and runs it
+ *
+ *  a long generated line, words of 40 to 200 letters with a $ or \
+ *  now and then, is gone through the way splitline and the expansion
+ *  pass did it, a char at a time, and then with scan_any at each level
+ *  the cpu has. The same is done for many short lines, where scan_any
+ *  should be no slower. Each result is MB/s and the speedup over the
+ *  char loop; the counts must agree or the run fails.
+ */
+
+#define	_POSIX_C_SOURCE	199309L
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<time.h>
+#include	"scan.h"
+
+#define	LONGLEN		(1 << 20)
+#define	SHORTLEN	40
+#define	MINTIME		0.2		/* seconds per measure	*/
+
+#define	is_delim(x) ((x)==' '||(x)=='\t')
+
+static char	*names[] = { "bytes", "sse2", "avx2" };
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *make_line(size_t len)
+{
+	char	*s = malloc(len);
+	size_t	i = 0, w;
+
+	while ( i < len ) {
+		for ( w = 40 + rand() % 160 ; w > 0 && i < len ; w-- )
+			s[i++] = 'a' + rand() % 26;
+		if ( i < len && rand() % 16 == 0 )
+			s[i++] = ( rand() % 2 ? '$' : '\\' );
+		if ( i < len )
+			s[i++] = ' ';
+	}
+	return s;
+}
+
+static long words_loop(char *s, size_t n)
+{
+	size_t	i = 0;
+	long	count = 0;
+
+	while ( i < n ) {
+		while ( i < n && is_delim(s[i]) )
+			i++;
+		if ( i == n )
+			break;
+		count++;
+		while ( i < n && !is_delim(s[i]) )
+			i++;
+	}
+	return count;
+}
+
+static long words_scan(char *s, size_t n)
+{
+	size_t	i = 0;
+	long	count = 0;
+
+	while ( i < n ) {
+		while ( i < n && is_delim(s[i]) )
+			i++;
+		if ( i == n )
+			break;
+		count++;
+		i += scan_any(s + i, n - i, " \t");
+	}
+	return count;
+}
+
+static long specials_loop(char *s, size_t n)
+{
+	size_t	i;
+	long	count = 0;
+
+	for ( i = 0 ; i < n ; i++ )
+		switch ( s[i] ) {
+			case '\\':
+			case '$':
+				count++;
+		}
+	return count;
+}
+
+static long specials_scan(char *s, size_t n)
+{
+	size_t	i = 0;
+	long	count = 0;
+
+	while ( (i += scan_any(s + i, n - i, "$\\")) < n )
+		count++, i++;
+	return count;
+}
+
+static double measure(long (*fn)(char *, size_t), char *s, size_t n,
+						size_t piece, long *countp)
+/*
+ * purpose: run fn over s in pieces of piece bytes until MINTIME is up
+ * returns: MB/s, with what fn counted on one pass in *countp
+ */
+{
+	double	start = now(), t;
+	long	passes = 0, count;
+	size_t	off;
+
+	do {
+		for ( count = 0, off = 0 ; off < n ; off += piece )
+			count += fn(s + off, piece < n - off ? piece : n - off);
+		passes++;
+	} while ( (t = now() - start) < MINTIME );
+	*countp = count;
+	return passes * (n / 1e6) / t;
+}
+
+static int run(char *what, long (*loop)(char *, size_t),
+		long (*scan)(char *, size_t), char *s, size_t n, size_t piece)
+{
+	double	base, rate;
+	long	want, got;
+	int	level, top = scan_use(-1);
+
+	base = measure(loop, s, n, piece, &want);
+	printf("%-24s %-6s %9.0f MB/s\n", what, "loop", base);
+	for ( level = SCAN_BYTES ; level <= top ; level++ ) {
+		scan_use(level);
+		rate = measure(scan, s, n, piece, &got);
+		printf("%-24s %-6s %9.0f MB/s  %5.2fx\n", what, names[level],
+						rate, rate / base);
+		if ( got != want ) {
+			fprintf(stderr, "bench_scan: %s %s: %ld, not %ld\n",
+					what, names[level], got, want);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	char	*s = make_line(LONGLEN);
+	int	rv = 0;
+
+	rv |= run("words, long line", words_loop, words_scan, s, LONGLEN,
+								LONGLEN);
+	rv |= run("$ and \\, long line", specials_loop, specials_scan, s,
+							LONGLEN, LONGLEN);
+	rv |= run("words, short lines", words_loop, words_scan, s, LONGLEN,
+								SHORTLEN);
+	rv |= run("$ and \\, short lines", specials_loop, specials_scan, s,
+							LONGLEN, SHORTLEN);
+	free(s);
+	return rv;
+}
@@ -7,6 +7,7 @@
 #include	<ctype.h>
 #include	<stdlib.h>
 #include	<inttypes.h>
+#include	<signal.h>
 #include	<errno.h>
 #include	<unistd.h>
 #include	<sys/types.h>
@@ -16,43 +17,74 @@
 #include	"varlib.h"
 #include	"builtin.h"
 #include	"splitline.h"
+#include	"function.h"
+#include	"controlflow.h"
+#include	"plugin.h"
+#include	"jobs.h"
+#include	"cond.h"
+#include	"fdread.h"
+#include	"process.h"
+#include	"coproc.h"
 
-int is_builtin(char **args, int *resultp)
 /*
- * purpose: run a builtin command 
- * returns: 1 if args[0] is builtin, 0 if not
- * details: test args[0] against all known builtins.  Call functions
+ * the table of builtins and keywords. The names are in cmdtab.def;
+ * mkcmdhash reads the same file at build time and writes cmdhash.h,
+ * a hash seed and slot table under which every name lands in a
+ * slot of its own. A lookup is then one hash and one strcmp, however
+ * many commands there are.
+ */
+static struct builtin cmdtab[] = {
+#define	CMD(name, fn, kind)	{ name, fn, kind },
+#include	"cmdtab.def"
+#undef	CMD
+};
+
+#include	"cmdhash.h"
+
+struct builtin *cmd_lookup(char *name)
+/*
+ * purpose: find a builtin or keyword
+ * returns: its table entry, or NULL if name is neither
+ *    note: builtins loaded with enable -f are found after the table
  */
 {
-	if ( is_assign_var(args[0], resultp) )
-		return 1;
-	if ( is_list_vars(args[0], resultp) )
-		return 1;
-	if ( is_export(args, resultp) )
-		return 1;
-	if ( is_cd(args, resultp) )
-		return 1;
-	if ( is_exit(args, resultp) )
-		return 1;
-	if ( is_read(args, resultp) )
-		return 1;
-	if ( is_exec(args, resultp) )
-		return 1;
-	return 0;
+	int	i = cmd_slot[cmd_hash(name, CMD_SEED) & CMD_MASK];
+
+	if ( i >= 0 && strcmp(cmdtab[i].name, name) == 0 )
+		return &cmdtab[i];
+	return plugin_lookup(name);
 }
+
+int is_assignment(char **args, int *resultp)
+/*
+ * purpose: run name=val, name[i]=val or name=( ... )
+ * returns: 1 if args is an assignment, 0 if not
+ */
+{
+	if ( strchr(args[0], '=') == NULL )
+		return 0;
+	return is_assign_array(args, resultp) || is_assign_var(args[0], resultp);
+}
+
 /* checks if a legal assignment cmd
  * if so, does it and retns 1
  * else return 0
  */
 int is_assign_var(char *cmd, int *resultp)
 {
-	char *eq_sign;
+	char *eq_sign, *end;
 	if ( (eq_sign = strchr(cmd, '=')) != NULL ){
-		if ( isdigit(cmd) ) /* bash variables cannot start with a digit */
+		if ( isdigit(*cmd) ) /* bash variables cannot start with a digit */
 			return 0;
 
-		for (char * substr = cmd; substr != eq_sign; substr++ ) {
-			if ( !(isalnum(*substr) || *substr != '_') )
+		end = eq_sign;
+		if ( eq_sign > cmd && eq_sign[-1] == '+' )	/* name+=val */
+			end--;
+		else if ( eq_sign > cmd && eq_sign[-1] == ']' )	/* name[i]=val */
+			if ( (end = strchr(cmd, '[')) == NULL || end > eq_sign )
+				return 0;
+		for (char * substr = cmd; substr != end; substr++ ) {
+			if ( !(isalnum(*substr) || *substr == '_') )
 				return 0;  /* bash vars are only alphanumeric with underscores */
 		}
 
@@ -62,47 +94,105 @@ int is_assign_var(char *cmd, int *resultp)
 	}
 	return 0;
 }
-/* checks if command is "set" : if so list vars */
-int is_list_vars(char *cmd, int *resultp)
+/* checks for name=( word ... ) and makes name an array of the words.
+ * the words were split by splitline so the ( and ) are stuck to the
+ * first and last of them
+ */
+int is_assign_array(char **args, int *resultp)
 {
-	if ( strcmp(cmd,"set") == 0 ){	     /* 'set' command? */
-		VLlist();
-		*resultp = 0;
-		return 1;
+	char	*name = args[0], *eq = strchr(name, '='), **v, **wp;
+	int	n, i, len, tag;
+
+	if ( eq == NULL || eq[1] != '(' )
+		return 0;
+	*eq = '\0';
+	if ( !okname(name) ) {
+		*eq = '=';
+		return 0;
 	}
+	args[0] = eq + 2;			/* words start after (	*/
+	wp = ( args[0][0] == '\0' ? args + 1 : args );
+	for ( n = 0 ; wp[n] != NULL ; n++ ) {
+		len = strlen(wp[n]);
+		if ( len > 0 && wp[n][len-1] == ')' )
+			break;
+	}
+	if ( wp[n] == NULL || wp[n+1] != NULL ) {
+		fprintf(stderr, "smsh: syntax error in array assignment\n");
+		*resultp = 1;
+	}
+	else {
+		tag = mem_tag(MT_VARLIB);
+		v = emalloc((n + 1) * sizeof(char *));
+		for ( i = 0 ; i <= n ; i++ )
+			v[i] = newstr(wp[i], strlen(wp[i]) - (i == n));
+		if ( v[n][0] == '\0' )		/* a lone )	*/
+			efree(v[n]);
+		else
+			n++;
+		mem_tag(tag);
+		*resultp = VLsetarray(name, v, n, NULL, 0);
+	}
+	args[0] = name;
+	*eq = '=';
+	return 1;
+}
+
+int exec_set(char **args)
+/*
+ * set - list the variables
+ */
+{
+	VLlist();
 	return 0;
 }
+
 /*
- * if an export command, then export it and ret 1
- * else ret 0
+ * export name - mark name for the environment
  * note: the opengroup says
  *  "When no arguments are given, the results are unspecified."
  */
-int is_export(char **args, int *resultp)
+int exec_export(char **args)
 {
-	if ( strcmp(args[0], "export") == 0 ){
-		if ( args[1] != NULL && okname(args[1]) )
-			*resultp = VLexport(args[1]);
-		else
-			*resultp = 1;
-		return 1;
-	}
-	return 0;
+	if ( args[1] != NULL && okname(args[1]) )
+		return VLexport(args[1]);
+	return 1;
 }
 
 int assign(char *str)
 /*
- * purpose: execute name=val AND ensure that name is legal
+ * purpose: execute name=val or name+=val AND ensure that name is legal
  * returns: -1 for illegal lval, or result of VLstore 
  * warning: modifies the string, but retores it to normal
  */
 {
-	char	*cp;
+	char	*cp, *br, *end;
 	int	rv ;
+	long	i;
 
 	cp = strchr(str,'=');
 	*cp = '\0';
-	rv = ( okname(str) ? VLstore(str,cp+1) : -1 );
+	if ( cp > str && cp[-1] == '+' ) {		/* name+=val	*/
+		cp[-1] = '\0';
+		rv = ( okname(str) ? VLappend(str, cp+1) : -1 );
+		cp[-1] = '+';
+	}
+	else if ( cp > str && cp[-1] == ']' && (br = strchr(str, '[')) != NULL ) {
+		*br = '\0';			/* name[i]=val	*/
+		i = strtol(br + 1, &end, 10);
+		if ( !okname(str) )
+			rv = -1;
+		else if ( end == br + 1 || end != cp - 1 ) {
+			fprintf(stderr, "smsh: %s[%.*s: bad array subscript\n",
+					str, (int)(cp - br - 1), br + 1);
+			rv = 1;
+		}
+		else
+			rv = VLsetelem(str, (int) i, cp+1);
+		*br = '[';
+	}
+	else
+		rv = ( okname(str) ? VLstore(str,cp+1) : -1 );
 	*cp = '=';
 	return rv;
 }
@@ -121,70 +211,114 @@ int okname(char *str)
 	return ( cp != str );	/* no empty strings, either */
 }
 
-int is_cd(char **args, int *resultp)
+int exec_memstats(char **args)
 /*
- * checks to see if the first argument is cd
- * if the arg is cd then call exec_cd with the preceding arguments 
+ * memstats - print the memory use of each subsystem
  */
 {
-	if ( strcmp(args[0], "cd") != 0 )
-		return 0;
-
-	*resultp = exec_cd(&args[1]);
-	return 1; 
+	mem_report();
+	return 0;
 }
 
-int is_exit(char **args, int *resultp)
+int exec_enable(char **args)
 /*
- * checks to see if the first argument is exit
- * if the arg is exit then call exec_exit to exit the shell
+ * enable -f lib.so name ...  - load builtins from a shared object
+ * enable -d name ...         - drop loaded builtins
+ * enable                     - list the loaded builtins
  */
-{ 
-	if ( strcmp(args[0], "exit") != 0 )
-		return 0;
-
-	*resultp = exec_exit(args + 1);
-	return 1; 
-}
+{
+	char	*cmd = args[0], *path = NULL;
+	int	rv = 0, drop = 0;
 
-int is_read(char **args, int *resultp)
-/*
- * checks to see if the first argument is read
- * if the arg is read then call exec_read to read 
- */
-{ 
-	if ( strcmp(args[0], "read") != 0 )
+	if ( args[1] == NULL ) {
+		plugin_list();
 		return 0;
-
-	*resultp = exec_read(args + 1);
-	return 1; 
+	}
+	if ( strcmp(args[1], "-f") == 0 && args[2] != NULL ) {
+		path = args[2];
+		args += 3;
+	}
+	else if ( strcmp(args[1], "-d") == 0 ) {
+		drop = 1;
+		args += 2;
+	}
+	else {
+		fprintf(stderr, "usage: %s [-f file | -d] name ...\n", cmd);
+		return 2;
+	}
+	for ( ; *args != NULL ; args++ ) {
+		if ( drop && plugin_unload(*args) != 0 ) {
+			fprintf(stderr, "%s: %s: not a loaded builtin\n", cmd, *args);
+			rv = 1;
+		}
+		else if ( !drop && plugin_load(path, *args) != 0 )
+			rv = 1;
+	}
+	return rv;
 }
 
-int is_exec(char **args, int *resultp)
+int exec_wait(char **args)
 /*
- * checks to see if the first argument is the exec command
+ * wait                 - wait for all background jobs, status 0
+ * wait id ...          - wait for each, status of the last one
+ * wait -n [id ...]     - wait for the first of them (or of all jobs)
+ *                        to end, status of that one
+ * an id is a pid or %n for job n. 127 for one that is not a job.
  */
 {
-	if ( strcmp(args[0], "exec") != 0)
+	struct job **list, *jp;
+	pid_t	pid;
+	int	n, i, given, rv = 0, tag;
+
+	if ( args[1] == NULL ) {
+		job_wait_all();
 		return 0;
-	*resultp = exec_exec(args);
-	return 1; 
+	}
+	if ( strcmp(args[1], "-n") != 0 ) {
+		for ( args++ ; *args != NULL ; args++ )
+			if ( (jp = job_find(*args)) != NULL )
+				rv = job_wait(jp);
+			else {
+				fprintf(stderr, "wait: %s: no such job\n", *args);
+				rv = 127;
+			}
+		return rv;
+	}
+
+	for ( given = 0 ; args[given + 2] != NULL ; given++ )	/* wait -n */
+		;
+	tag = mem_tag(MT_JOBS);
+	list = emalloc((given + 1) * sizeof(struct job *));
+	mem_tag(tag);
+	for ( n = 0, args += 2 ; *args != NULL ; args++ ) {
+		if ( (jp = job_find(*args)) == NULL ) {
+			fprintf(stderr, "wait: %s: no such job\n", *args);
+			continue;
+		}
+		for ( i = 0 ; i < n && list[i] != jp ; i++ )
+			;
+		if ( i == n )
+			list[n++] = jp;
+	}
+	rv = ( n > 0 || given == 0 ? job_wait_any(list, n, &pid) : -1 );
+	efree(list);
+	return ( rv == -1 ? 127 : rv );
 }
 
 int exec_exit(char ** args)
 {
 	int exit_status = 0;
 	char *endptr;
-	if ( args[0] != NULL && args[1] != NULL ) { /* ex: exit 5 foo */
-		fprintf(stderr, "%s  ", args[1]);
+	if ( args[1] != NULL && args[2] != NULL ) { /* ex: exit 5 foo */
+		fprintf(stderr, "%s  ", args[2]);
 		fprintf(stderr, "exit: too many arguments\n");
 		return -1;
 	}
 
-	if ( args[0] != NULL ) { 					/* ex: exit 3 */
-		exit_status = strtol(args[0], &endptr, 10);
+	if ( args[1] != NULL ) { 					/* ex: exit 3 */
+		exit_status = strtol(args[1], &endptr, 10);
 		if ( strlen(endptr) > 0 ) {  /* the exit status was not just a number */
-			fprintf(stderr, "exit: %s: numeric argument required\n", args[0]);
+			fprintf(stderr, "exit: %s: numeric argument required\n", args[1]);
 			return -1; 
 		} 
 	}
@@ -198,11 +332,11 @@ int exec_cd(char ** args)
 	int rv = 0;
 	char *home;
 
-	if ( args[0] == NULL ) {
+	if ( args[1] == NULL ) {
 		home = VLlookup("HOME");
 		rv = chdir(home); 
 	} else {
-		rv = chdir(args[0]); 
+		rv = chdir(args[1]); 
 	}
 
 	if ( rv == -1 ) {
@@ -212,29 +346,544 @@ int exec_cd(char ** args)
 	return rv;
 }
 
+static int num_arg(char *cmd, char *opt, char *arg, long *np)
+/*
+ * the number after an option, returns 0 for ok
+ */
+{
+	char	*end;
+
+	if ( arg != NULL ) {
+		*np = strtol(arg, &end, 10);
+		if ( end != arg && *end == '\0' && *np >= 0 )
+			return 0;
+	}
+	fprintf(stderr, "%s: %s: invalid number\n", cmd, opt);
+	return 1;
+}
+
+static char *field(char *p, char *kind, int raw, int last)
+/*
+ * purpose: cut the field at p out of a line for read, in place: take
+ *          out the backslashes unless raw, end it at an IFS char or, for
+ *          the last name, take the rest less its trailing IFS blanks
+ * returns: where the next field starts
+ */
+{
+	char	*w = p, *keep = p;
+	int	esc;
+
+	while ( *p != '\0' && (last || kind[(unsigned char) *p] == 0
+					|| (!raw && *p == '\\')) ) {
+		esc = ( !raw && *p == '\\' && p[1] != '\0' );
+		p += esc;
+		*w++ = *p++;
+		if ( esc || kind[(unsigned char) w[-1]] != 1 )
+			keep = w;
+	}
+	if ( !last )
+		keep = w;
+	while ( kind[(unsigned char) *p] == 1 )		/* the separator */
+		p++;
+	if ( kind[(unsigned char) *p] == 2 )
+		for ( p++ ; kind[(unsigned char) *p] == 1 ; p++ )
+			;
+	*keep = '\0';
+	return p;
+}
+
 int exec_read(char ** args)
 /*
- * reads from user input and stores value in the first argument to read
- * if no argument in supplied, user input is stored on REPLY variable
+ * read [-r] [-u fd] [-d delim] [-n count] [-p prompt] [name...]
+ * reads a line from fd (default 0) and splits it on the chars of IFS
+ * into the names, the last taking what is left; with no names the
+ * whole line goes in REPLY. A backslash quotes the next char, and one
+ * at the end of a line joins the next line on, unless -r is given.
+ * -d ends the line at delim instead of a newline, -n after count chars.
+ * fdread.c does the reading so that nothing past the line is taken.
+ * returns 0, or 1 at end of file or for an error, 2 for bad usage
  */
 {
-	char * key;
+	char	*cmd = args[0], *prompt = NULL, *ifs, *p, *line;
+	char	kind[256];
+	long	fd = 0, max = -1;
+	int	raw = 0, delim = '\n', rv, n, tag;
+	FLEXSTR	buf;
 
-	if ( args[0] == NULL )
-		key = "REPLY";
-	else
-		key = args[0];
+	for ( args++ ; args[0] != NULL && args[0][0] == '-' ; args++ ) {
+		if ( strcmp(args[0], "-r") == 0 )
+			raw = 1;
+		else if ( strcmp(args[0], "-u") == 0 ) {
+			if ( num_arg(cmd, args[0], args[1], &fd) )
+				return 2;
+			args++;
+		}
+		else if ( strcmp(args[0], "-n") == 0 ) {
+			if ( num_arg(cmd, args[0], args[1], &max) )
+				return 2;
+			args++;
+		}
+		else if ( strcmp(args[0], "-d") == 0 && args[1] != NULL ) {
+			delim = (unsigned char) args[1][0];
+			args++;
+		}
+		else if ( strcmp(args[0], "-p") == 0 && args[1] != NULL )
+			prompt = *++args;
+		else {
+			fprintf(stderr, "%s: %s: invalid option\n", cmd, args[0]);
+			return 2;
+		}
+	}
+	for ( n = 0 ; args[n] != NULL ; n++ )
+		if ( !okname(args[n]) ) {
+			fprintf(stderr, "%s: %s: not a valid identifier\n",
+								cmd, args[n]);
+			return 1;
+		}
+	if ( prompt != NULL && isatty((int) fd) ) {
+		fputs(prompt, stderr);
+		fflush(stderr);
+	}
+
+	tag = mem_tag(MT_EXPAND);
+	fs_init(&buf, 0);
+	while ( (rv = fdr_read((int) fd, delim, max, &buf)) == 1 && !raw
+			&& max < 0 ) {		/* \ at the end: go on	*/
+		for ( n = 0 ; n < buf.fs_used
+				&& buf.fs_str[buf.fs_used - n - 1] == '\\' ; n++ )
+			;
+		if ( n % 2 == 0 )
+			break;
+		buf.fs_used--;
+	}
+	line = fs_getstr(&buf);
+	mem_tag(tag);
+	if ( rv == -1 )
+		perror(cmd);
+
+	memset(kind, 0, sizeof(kind));
+	if ( args[0] == NULL ) {		/* all of it, as it came */
+		field(line, kind, raw, 1);
+		VLstore("REPLY", line);
+	}
+	else {
+		ifs = ( VLisset("IFS") ? VLlookup("IFS") : " \t\n" );
+		for ( p = ifs ; *p != '\0' ; p++ )
+			kind[(unsigned char) *p] = ( strchr(" \t\n", *p) ? 1 : 2 );
+		for ( p = line ; kind[(unsigned char) *p] == 1 ; p++ )
+			;
+		for ( ; args[0] != NULL ; args++ ) {
+			line = p;
+			p = field(p, kind, raw, args[1] == NULL);
+			VLstore(args[0], line);
+		}
+	}
+	fs_free(&buf);
+	return rv != 1;
+}
+
+int exec_print(char **args)
+/*
+ * print [-n] [-u fd] [--] [word...]
+ * writes the words with a space between them and a newline after,
+ * unless -n, to fd (default 1). To another fd the line goes in one
+ * write, so a coprocess reading it gets it whole.
+ * returns 0, 1 if the write failed, 2 for bad usage
+ */
+{
+	char	*cmd = args[0];
+	long	fd = 1;
+	int	newline = 1, rv = 0, tag;
+	ssize_t	n;
+	size_t	done;
+	FLEXSTR	buf;
 
-	char *prompt = "";
-	char *input = next_cmd(prompt, stdin);
+	for ( args++ ; args[0] != NULL && args[0][0] == '-' ; args++ ) {
+		if ( strcmp(args[0], "--") == 0 ) {
+			args++;
+			break;
+		}
+		if ( strcmp(args[0], "-n") == 0 )
+			newline = 0;
+		else if ( strcmp(args[0], "-u") == 0 ) {
+			if ( num_arg(cmd, args[0], args[1], &fd) )
+				return 2;
+			args++;
+		}
+		else {
+			fprintf(stderr, "%s: %s: invalid option\n", cmd, args[0]);
+			return 2;
+		}
+	}
 
-	VLstore(key, input);
-	return 1; 
+	tag = mem_tag(MT_EXPAND);
+	fs_init(&buf, 0);
+	for ( ; args[0] != NULL ; args++ ) {
+		fs_addmem(&buf, args[0], strlen(args[0]));
+		if ( args[1] != NULL )
+			fs_addch(&buf, ' ');
+	}
+	if ( newline )
+		fs_addch(&buf, '\n');
+	mem_tag(tag);
+	if ( fd == 1 )				/* after what stdio holds */
+		rv = fwrite(buf.fs_str, 1, buf.fs_used, stdout) != buf.fs_used;
+	else
+		for ( done = 0 ; done < buf.fs_used ; done += n )
+			if ( (n = write((int) fd, buf.fs_str + done,
+						buf.fs_used - done)) == -1 ) {
+				if ( errno == EINTR ) {
+					n = 0;
+					continue;
+				}
+				perror(cmd);
+				rv = 1;
+				break;
+			}
+	fs_free(&buf);
+	return rv;
 }
 
 int exec_exec(char **args)
 {
+	signal(SIGPIPE, SIG_DFL);
 	execvp(args[1], args + 1);
 	perror(args[0]);
 	exit(1);
 }
+
+int exec_shift(char **args)
+/*
+ * shift [n] - renumber the positional parameters, n defaults to 1
+ */
+{
+	int n = 1;
+	char *endptr;
+
+	if ( args[1] != NULL ) {
+		n = strtol(args[1], &endptr, 10);
+		if ( *endptr != '\0' || n < 0 ) {
+			fprintf(stderr, "shift: %s: numeric argument required\n", args[1]);
+			return 1;
+		}
+	}
+	return VLshift(n);
+}
+
+int exec_return(char **args)
+/*
+ * return [n] - leave the running function with status n,
+ * n defaults to the status of the last command
+ */
+{
+	int n = VLstatus();
+	char *endptr;
+
+	if ( args[1] != NULL ) {
+		n = strtol(args[1], &endptr, 10);
+		if ( *endptr != '\0' ) {
+			fprintf(stderr, "return: %s: numeric argument required\n", args[1]);
+			n = 2;
+		}
+	}
+	if ( fn_return(n) == -1 ) {
+		fprintf(stderr, "return: can only return from a function\n");
+		return 1;
+	}
+	return n;
+}
+
+int exec_local(char **args)
+/*
+ * local name[=value] ... - make variables local to the running function
+ */
+{
+	char	*cp;
+	int	rv = 0;
+
+	for ( args++ ; args[0] != NULL ; args++ ) {
+		if ( (cp = strchr(args[0], '=')) != NULL )
+			*cp = '\0';
+		if ( !okname(args[0]) ) {
+			fprintf(stderr, "local: %s: not a valid identifier\n", args[0]);
+			rv = 1;
+		}
+		else if ( VLlocal(args[0], cp ? cp + 1 : "") != 0 ) {
+			fprintf(stderr, "local: can only be used in a function\n");
+			rv = 1;
+		}
+		if ( cp != NULL )
+			*cp = '=';
+		if ( rv == 1 )
+			break;
+	}
+	return rv;
+}
+
+int exec_declare(char **args)
+/*
+ * declare [-i|+i] [name[=value] ...] - set variables, with -i as
+ * integers that hold a number and take arithmetic, with +i as plain
+ * strings again. In a function the names are made local. With no
+ * names it lists the variables as set does.
+ */
+{
+	char	*cp;
+	int	rv = 0, attr = -1;		/* -1: leave it alone	*/
+
+	for ( args++ ; args[0] != NULL
+			&& (args[0][0] == '-' || args[0][0] == '+') ; args++ ) {
+		if ( strcmp(args[0] + 1, "i") != 0 ) {
+			fprintf(stderr, "declare: %s: invalid option\n", args[0]);
+			return 2;
+		}
+		attr = ( args[0][0] == '-' );
+	}
+	if ( args[0] == NULL ) {
+		VLlist();
+		return 0;
+	}
+	for ( ; args[0] != NULL && rv == 0 ; args++ ) {
+		if ( (cp = strchr(args[0], '=')) != NULL )
+			*cp = '\0';
+		if ( !okname(args[0]) ) {
+			fprintf(stderr, "declare: %s: not a valid identifier\n",
+								args[0]);
+			rv = 1;
+		}
+		else {
+			VLlocal(args[0], NULL);	/* fails outside a function */
+			if ( attr != -1 )
+				rv = VLsetint(args[0], attr);
+			if ( rv == 0 && cp != NULL )
+				rv = VLstore(args[0], cp + 1);
+		}
+		if ( cp != NULL )
+			*cp = '=';
+	}
+	return rv;
+}
+
+static char *read_all(int fd, long want, size_t *lenp)
+/*
+ * reads fd to the end in large chunks, or until want lines are in
+ * when want > 0. A file is then put back to just after the last of
+ * those lines; a pipe is read a byte at a time instead so nothing
+ * past them is taken.
+ * returns the bytes read with room for one more, NULL on error
+ */
+{
+	size_t	len = 0, cap = 65536, used;
+	long	lines = 0;
+	ssize_t	nr;
+	char	*buf = emalloc(cap), *p;
+	int	bytewise = ( want > 0 && lseek(fd, 0, SEEK_CUR) == -1 );
+
+	while ( (nr = read(fd, buf + len, bytewise ? 1 : cap - len - 1)) > 0 ) {
+		for ( p = buf + len ; want > 0 &&
+		      (p = memchr(p, '\n', buf + len + nr - p)) != NULL ; p++ )
+			if ( ++lines == want )
+				break;
+		len += nr;
+		if ( want > 0 && lines == want ) {
+			used = p + 1 - buf;
+			if ( used < len )
+				lseek(fd, (off_t) used - (off_t) len, SEEK_CUR);
+			len = used;
+			break;
+		}
+		if ( len + 1 == cap )
+			buf = erealloc(buf, cap *= 2);
+	}
+	if ( nr == -1 ) {
+		efree(buf);
+		return NULL;
+	}
+	*lenp = len;
+	return erealloc(buf, len + 1);		/* give back the slack	*/
+}
+
+int exec_mapfile(char **args)
+/*
+ * mapfile [-t] [-n count] [-s skip] [-u fd] [name]
+ * reads lines from fd (default 0) into the array name (MAPFILE).
+ * the input is read in one pass into one block and the elements
+ * point into it, so no line is copied or parsed on its own.
+ */
+{
+	char	*cmd = args[0], *name = "MAPFILE", *buf, *block, *p, *nl, **v;
+	long	count = 0, skip = 0, fd = 0;
+	int	trim = 0, n = 0, max = 0, line = 0, tag, rv;
+	size_t	len, blen;
+
+	for ( args++ ; args[0] != NULL && args[0][0] == '-' ; args++ ) {
+		if ( strcmp(args[0], "-t") == 0 )
+			trim = 1;
+		else if ( strcmp(args[0], "-n") == 0 ) {
+			if ( num_arg(cmd, args[0], args[1], &count) )
+				return 1;
+			args++;
+		}
+		else if ( strcmp(args[0], "-s") == 0 ) {
+			if ( num_arg(cmd, args[0], args[1], &skip) )
+				return 1;
+			args++;
+		}
+		else if ( strcmp(args[0], "-u") == 0 ) {
+			if ( num_arg(cmd, args[0], args[1], &fd) )
+				return 1;
+			args++;
+		}
+		else {
+			fprintf(stderr, "%s: %s: invalid option\n", cmd, args[0]);
+			return 1;
+		}
+	}
+	if ( args[0] != NULL && args[1] != NULL ) {
+		fprintf(stderr, "%s: too many arguments\n", cmd);
+		return 1;
+	}
+	if ( args[0] != NULL )
+		name = args[0];
+	if ( !okname(name) ) {
+		fprintf(stderr, "%s: %s: not a valid identifier\n", cmd, name);
+		return 1;
+	}
+
+	tag = mem_tag(MT_VARLIB);
+	if ( (buf = read_all((int) fd, count ? count + skip : 0, &len)) == NULL ) {
+		mem_tag(tag);
+		perror(cmd);
+		return 1;
+	}
+	if ( trim ) {				/* lines end where \n was */
+		block = buf;
+		blen = len + 1;
+	}
+	else {					/* room for a \0 per line */
+		for ( blen = len + 1, p = buf ;
+		      (p = memchr(p, '\n', buf + len - p)) != NULL ; p++ )
+			blen++;
+		block = emalloc(blen);
+	}
+
+	v = NULL;
+	for ( p = buf ; p < buf + len ; p = nl + 1 ) {
+		if ( (nl = memchr(p, '\n', buf + len - p)) == NULL )
+			nl = buf + len;		/* last line, no \n	*/
+		if ( line++ < skip )
+			continue;
+		if ( n == max ) {
+			max = max ? 2 * max : 64;
+			v = erealloc(v, max * sizeof(char *));
+		}
+		if ( trim ) {
+			*nl = '\0';
+			v[n++] = p;
+		}
+		else {
+			v[n] = block + (p - buf) + line - 1;
+			memcpy(v[n], p, nl - p + (nl < buf + len));
+			v[n][nl - p + (nl < buf + len)] = '\0';
+			n++;
+		}
+	}
+	if ( !trim )
+		efree(buf);
+	if ( v == NULL )
+		v = emalloc(sizeof(char *));
+	mem_tag(tag);
+	rv = VLsetarray(name, v, n, block, blen);
+	return rv;
+}
+
+static int duration(char *cmd, char *s, double *secp)
+/*
+ * a number of seconds, maybe with a fraction and an s, m, h or d after
+ * it, returns 0 for ok
+ */
+{
+	static char units[] = "smhd";
+	static double secs[] = { 1, 60, 3600, 86400 };
+	char	*end, *u;
+
+	*secp = strtod(s, &end);
+	if ( end != s && *secp >= 0 ) {
+		if ( *end == '\0' )
+			return 0;
+		if ( end[1] == '\0' && (u = strchr(units, *end)) != NULL ) {
+			*secp *= secs[u - units];
+			return 0;
+		}
+	}
+	fprintf(stderr, "%s: %s: invalid time interval\n", cmd, s);
+	return 1;
+}
+
+static int signum(char *name)
+/*
+ * a signal by number or by name, with or without SIG; -1 if not known
+ */
+{
+	static struct { char *name; int sig; } sigs[] = {
+		{ "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT },
+		{ "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+		{ "ALRM", SIGALRM }, { "TERM", SIGTERM }, { NULL, 0 } };
+	char	*end;
+	int	i;
+
+	if ( isdigit((unsigned char) *name) ) {
+		i = strtol(name, &end, 10);
+		return ( *end == '\0' && i > 0 && i < 65 ? i : -1 );
+	}
+	if ( strncmp(name, "SIG", 3) == 0 )
+		name += 3;
+	for ( i = 0 ; sigs[i].name != NULL ; i++ )
+		if ( strcmp(sigs[i].name, name) == 0 )
+			return sigs[i].sig;
+	return -1;
+}
+
+int exec_timeout(char **args)
+/*
+ * timeout [-s sig] [-k grace] duration command [args...]
+ * runs the command and sends it sig (TERM) if it is still running after
+ * duration, then KILL grace (5s) after that unless grace is 0. A time
+ * is seconds, with an optional fraction and s, m, h or d; a duration of
+ * 0 means no limit. execute_timed does the waiting.
+ * returns the command's status, 124 if it timed out, 125 for bad usage
+ */
+{
+	char	*cmd = args[0];
+	double	limit, grace = 5;
+	int	sig = SIGTERM;
+
+	for ( args++ ; args[0] != NULL && args[0][0] == '-' ; args += 2 ) {
+		if ( strcmp(args[0], "-s") == 0 && args[1] != NULL ) {
+			if ( (sig = signum(args[1])) == -1 ) {
+				fprintf(stderr, "%s: %s: invalid signal\n", cmd,
+									args[1]);
+				return 125;
+			}
+		}
+		else if ( strcmp(args[0], "-k") == 0 && args[1] != NULL ) {
+			if ( duration(cmd, args[1], &grace) )
+				return 125;
+		}
+		else {
+			fprintf(stderr, "%s: %s: invalid option\n", cmd, args[0]);
+			return 125;
+		}
+	}
+	if ( args[0] == NULL || args[1] == NULL ) {
+		fprintf(stderr, "usage: %s [-s sig] [-k grace] duration command"
+						" [args...]\n", cmd);
+		return 125;
+	}
+	if ( duration(cmd, args[0], &limit) )
+		return 125;
+	if ( limit == 0 )
+		return do_command(args + 1, cmd_lookup(args[1]));
+	return execute_timed(args + 1, cmd_lookup(args[1]), limit, sig,
+						grace > 0 ? grace : -1);
+}
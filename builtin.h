@@ -1,20 +1,50 @@
 #ifndef	BUILTIN_H
 #define	BUILTIN_H
 
-int is_builtin(char **args, int *resultp);
+enum cmd_kinds { CMD_BUILTIN, CMD_KEYWORD };
+
+struct builtin {			/* an entry of cmdtab.def	*/
+	char	*name;
+	int	(*fn)(char **);		/* gets the whole arglist	*/
+	int	kind;
+};
+
+/*
+ * the hash cmdhash.h is generated for: FNV-1a started from a seed.
+ * the low bits of a product only see the low bits of the seed, so
+ * the high bits are folded down before the caller masks.
+ */
+static inline unsigned cmd_hash(const char *s, unsigned seed)
+{
+	unsigned h = seed;
+
+	while ( *s )
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return h ^ (h >> 15);
+}
+
+struct builtin *cmd_lookup(char *);
+int is_assignment(char **args, int *resultp);
 int is_assign_var(char *cmd, int *resultp);
-int is_list_vars(char *cmd, int *resultp);
+int is_assign_array(char **, int *);
 int assign(char *);
 int okname(char *);
-int is_export(char **, int *);
-int is_cd(char **, int *);
-int is_exit(char **, int *);
-int is_read(char **, int *);
-int is_exec(char **, int *);
 
+int exec_set(char **);
+int exec_export(char **);
 int exec_cd(char **);
 int exec_exit(char **);
 int exec_read(char **);
+int exec_print(char **);
 int exec_exec(char **);
+int exec_shift(char **);
+int exec_return(char **);
+int exec_local(char **);
+int exec_memstats(char **);
+int exec_mapfile(char **);
+int exec_enable(char **);
+int exec_wait(char **);
+int exec_declare(char **);
+int exec_timeout(char **);
 
 #endif
@@ -0,0 +1,213 @@
+/* case.c - the patterns of case ... esac
+ *
+ *    case_match( word, wlen, pats, len )   does word match pats, a|b|...
+ *
+ *  a pattern list is compiled the first time its text is seen. It is
+ *  cut on | into alternatives and each gets the cheapest test that
+ *  will do: a literal (no * ? or [...]) is a length check and memcmp,
+ *  lit* and *lit one memcmp at the front or the back, a lone * always
+ *  matches, and anything else goes to pmatch, which is fnmatch(3)
+ *  with no flags. Compiled lists are kept in a hash table under their
+ *  text, so a case in a function body that runs many times compiles
+ *  its patterns once. A list with a $ in it is expanded and compiled
+ *  every time, since its value can change.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"varlib.h"
+#include	"match.h"
+#include	"case.h"
+
+#define	NBUCKETS	64
+
+enum kinds { P_LITERAL, P_PREFIX, P_SUFFIX, P_ANY, P_GLOB };
+
+struct alt {
+		int	kind;
+		char	*text;		/* unescaped, or the pattern	*/
+		size_t	len;
+	};
+
+struct patlist {
+		char	*src;		/* the text it was made from	*/
+		size_t	srclen;
+		struct alt *alts;
+		int	n;
+		struct patlist *next;	/* hash chain			*/
+	};
+
+static struct patlist *table[NBUCKETS];
+
+static char *unescape(char *s, size_t n, size_t *lenp)
+/*
+ * a copy of n chars of s with each \c made c
+ */
+{
+	char	*rv = emalloc(n + 1), *d = rv;
+	size_t	i;
+
+	for ( i = 0 ; i < n ; i++ ) {
+		if ( s[i] == '\\' && i + 1 < n )
+			i++;
+		*d++ = s[i];
+	}
+	*d = '\0';
+	*lenp = d - rv;
+	return rv;
+}
+
+static int plain(char *s, size_t n)
+/*
+ * are n chars of s free of wildcards?
+ */
+{
+	char	*copy = newstr(s, n);
+	int	rv = !has_wildcards(copy);
+
+	efree(copy);
+	return rv;
+}
+
+static void compile_alt(struct alt *ap, char *s, size_t n)
+/*
+ * purpose: pick the test for one alternative
+ *    note: a * is taken as a wildcard at the end only if no \ is
+ *          right before it
+ */
+{
+	if ( n == 1 && s[0] == '*' )
+		ap->kind = P_ANY;
+	else if ( plain(s, n) )
+		ap->kind = P_LITERAL;
+	else if ( n > 1 && s[n-1] == '*' && s[n-2] != '\\' && plain(s, n - 1) ) {
+		ap->kind = P_PREFIX;
+		n--;
+	}
+	else if ( n > 1 && s[0] == '*' && plain(s + 1, n - 1) ) {
+		ap->kind = P_SUFFIX;
+		s++, n--;
+	}
+	else {
+		ap->kind = P_GLOB;
+		ap->text = newstr(s, n);
+		ap->len  = n;
+		return;
+	}
+	ap->text = unescape(s, n, &ap->len);
+}
+
+static struct patlist *compile(char *s, size_t n)
+/*
+ * purpose: cut a pattern list on | and compile each part
+ *    note: a | inside [...] or after a \ does not cut
+ */
+{
+	struct patlist *pl = emalloc(sizeof(struct patlist));
+	size_t	i, start = 0;
+	int	in_set = 0, max = 4;
+
+	pl->src    = newstr(s, n);
+	pl->srclen = n;
+	pl->alts   = emalloc(max * sizeof(struct alt));
+	pl->n      = 0;
+	pl->next   = NULL;
+	for ( i = 0 ; i <= n ; i++ ) {
+		if ( i < n && s[i] == '\\' )
+			i++;
+		else if ( i < n && s[i] == '[' )
+			in_set = 1;
+		else if ( i < n && s[i] == ']' )
+			in_set = 0;
+		else if ( i == n || (s[i] == '|' && !in_set) ) {
+			if ( pl->n == max ) {
+				max *= 2;
+				pl->alts = erealloc(pl->alts, max * sizeof(struct alt));
+			}
+			compile_alt(&pl->alts[pl->n++], s + start, i - start);
+			start = i + 1;
+		}
+	}
+	return pl;
+}
+
+static void free_list(struct patlist *pl)
+{
+	int	i;
+
+	for ( i = 0 ; i < pl->n ; i++ )
+		efree(pl->alts[i].text);
+	efree(pl->alts);
+	efree(pl->src);
+	efree(pl);
+}
+
+static struct patlist *lookup(char *s, size_t n)
+/*
+ * the compiled form of s, made and kept the first time
+ */
+{
+	struct patlist *pl;
+	unsigned h = 0;
+	size_t	i;
+	int	tag;
+
+	for ( i = 0 ; i < n ; i++ )
+		h = h * 31 + (unsigned char) s[i];
+	h %= NBUCKETS;
+	for ( pl = table[h] ; pl != NULL ; pl = pl->next )
+		if ( pl->srclen == n && memcmp(pl->src, s, n) == 0 )
+			return pl;
+	tag = mem_tag(MT_OTHER);
+	pl = compile(s, n);
+	mem_tag(tag);
+	pl->next = table[h];
+	table[h] = pl;
+	return pl;
+}
+
+static int match_alt(struct alt *ap, char *word, size_t wlen)
+{
+	switch ( ap->kind ) {
+	case P_LITERAL:
+		return wlen == ap->len && memcmp(word, ap->text, wlen) == 0;
+	case P_PREFIX:
+		return wlen >= ap->len && memcmp(word, ap->text, ap->len) == 0;
+	case P_SUFFIX:
+		return wlen >= ap->len
+			&& memcmp(word + wlen - ap->len, ap->text, ap->len) == 0;
+	case P_ANY:
+		return 1;
+	}
+	return pmatch(ap->text, word);
+}
+
+int case_match(char *word, size_t wlen, char *pats, size_t len)
+/*
+ * purpose: match the word of a case, wlen chars, against the pattern
+ *          list of a clause, the len chars before its )
+ * returns: 1 if one of the patterns matches, 0 if not
+ */
+{
+	struct patlist *pl;
+	char	*exp;
+	int	i, rv = 0, temp = 0;
+
+	if ( memchr(pats, '$', len) != NULL
+			&& (exp = substitute_variables(pats, len)) != NULL ) {
+		pl = compile(exp, strlen(exp));
+		efree(exp);
+		temp = 1;
+	}
+	else
+		pl = lookup(pats, len);
+	for ( i = 0 ; i < pl->n && !rv ; i++ )
+		rv = match_alt(&pl->alts[i], word, wlen);
+	if ( temp )
+		free_list(pl);
+	return rv;
+}
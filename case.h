@@ -0,0 +1,10 @@
+#ifndef	CASE_H
+#define	CASE_H
+/*
+ * header for case.c - the patterns of case ... esac
+ */
+#include	<stddef.h>
+
+int	case_match(char *, size_t, char *, size_t);
+
+#endif
@@ -0,0 +1,436 @@
+/* cmdlist.c - command lists for smsh
+ *
+ *    cl_find( line, len )         does the line hold a list operator?
+ *    cl_next( line, len, &pos, &oplen ) where the command at pos ends
+ *    cl_split( line, len, &list ) cut a line into its commands
+ *    cl_run( line, len )          run a list, returns the last status
+ *
+ *  a list is commands joined by ; && || and &. It is cut up on the raw
+ *  line, before any expansion, so a $var whose value has a ; in it is
+ *  not a list. Each command is expanded and split only when its turn
+ *  comes: in  a && b || c  nothing of b is looked at if a failed.
+ *
+ *  && and || bind left to right with equal weight, as in sh, so each
+ *  command is run or skipped by looking at the status so far and the
+ *  operator in front of it. An and-or list ending in & runs as one job.
+ *
+ *  a \ quotes the next char, and ${...} and [[ ... ]] are skipped over
+ *  whole, so none of them can end a command; the && and || of a [[ are
+ *  its own. A # at the start of a word ends the line. Chars that are
+ *  none of those are passed over with scan_any.
+ *  ;; ends a clause of a case; it may follow an empty command.
+ *
+ *  ( list ) and { list; } at the start of a word are skipped over whole
+ *  too, and are one command of the list around them. ( list ) runs in a
+ *  fork of this shell, which runs the list from the text it already has
+ *  and starts with a copy on write of all the shell's state: nothing is
+ *  exec'd and nothing set up again. { list; } runs in this shell. Both
+ *  are on one line, like the rest of a list.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<sys/wait.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"varlib.h"
+#include	"controlflow.h"
+#include	"jobs.h"
+#include	"process.h"
+#include	"function.h"
+#include	"cmdlist.h"
+#include	"scan.h"
+
+#define	is_blank(c)	((c) == ' ' || (c) == '\t')
+#define	LISTCHARS	"\\$}]([{#;&|"	/* all cl_next looks at	*/
+
+static char *opname[] = { "newline", ";", "&&", "||", "&", ";;" };
+
+static int	run_chain(struct cl_part *, int, int);
+static int	run_part(struct cl_part *);
+
+static int word_start(char *s, size_t i)
+{
+	return i == 0 || strchr(" \t;&|(", s[i-1]) != NULL;
+}
+
+static int word_end(char *s, size_t len, size_t i)
+{
+	return i + 1 >= len || strchr(" \t;&|)", s[i+1]) != NULL;
+}
+
+static int opens_group(char *s, size_t len, size_t i)
+/*
+ * does a ( list ) or { list; } start at s[i]?
+ */
+{
+	return word_start(s, i) && (s[i] == '('
+			|| (s[i] == '{' && i + 1 < len && is_blank(s[i+1])));
+}
+
+static size_t group_end(char *s, size_t len, size_t i)
+/*
+ * purpose: find the end of the group that opens at s[i]
+ * returns: the index just after its ) or }, 0 if it is not closed
+ *    note: ( and ) pair up wherever they are, so a=( x ) inside is
+ *          fine; { and } count only as words of their own
+ */
+{
+	int	open = s[i], depth = 0;
+
+	for ( ; i < len ; i++ ) {
+		if ( s[i] == '\\' )
+			i++;
+		else if ( open == '(' && (s[i] == '(' || s[i] == ')') )
+			depth += ( s[i] == '(' ? 1 : -1 );
+		else if ( open == '{' && (s[i] == '{' || s[i] == '}')
+				&& word_start(s, i) && word_end(s, len, i) )
+			depth += ( s[i] == '{' ? 1 : -1 );
+		else
+			continue;
+		if ( depth == 0 )
+			return i + 1;
+	}
+	return 0;
+}
+
+int cl_next(char *s, size_t len, size_t *posp, size_t *oplenp)
+/*
+ * purpose: find the next list operator at or after *posp
+ * returns: its kind, with *posp set to it and *oplenp to its length.
+ *          CL_END at the end of the line or at a comment, with *posp
+ *          at the end of the last command.
+ *    note: a & after < or > belongs to a redirection like 2>&1
+ */
+{
+	size_t	i;
+	int	depth = 0,			/* inside ${ }		*/
+		cond = 0;			/* inside [[ ]]		*/
+
+	for ( i = *posp ; i < len ; i++ ) {
+		if ( (i += scan_any(s + i, len - i, LISTCHARS)) == len )
+			break;
+		switch ( s[i] ) {
+		case '\\':
+			i++;
+			continue;
+		case '$':
+			if ( i + 1 < len && s[i+1] == '{' )
+				depth++, i++;
+			continue;
+		case '}':
+			if ( depth > 0 )
+				depth--;
+			continue;
+		}
+		if ( depth > 0 )
+			continue;
+		if ( cond ) {
+			if ( s[i] == ']' && i + 1 < len && s[i+1] == ']'
+					&& is_blank(s[i-1]) )
+				cond = 0, i++;
+			continue;
+		}
+		if ( opens_group(s, len, i) ) {
+			if ( (i = group_end(s, len, i)) == 0 )
+				i = len;		/* run_part complains */
+			i--;
+			continue;
+		}
+		if ( s[i] == '[' && i + 2 < len && s[i+1] == '[' && is_blank(s[i+2])
+				&& (i == 0 || strchr(" \t;&|", s[i-1]) != NULL) ) {
+			cond = 1;
+			i++;
+			continue;
+		}
+		*posp = i;
+		*oplenp = 1;
+		switch ( s[i] ) {
+		case '#':
+			if ( i == 0 || strchr(" \t;&|", s[i-1]) != NULL )
+				return CL_END;
+			break;
+		case ';':
+			if ( i + 1 < len && s[i+1] == ';' ) {
+				*oplenp = 2;
+				return CL_DSEMI;
+			}
+			return CL_SEQ;
+		case '&':
+			if ( i + 1 < len && s[i+1] == '&' ) {
+				*oplenp = 2;
+				return CL_AND;
+			}
+			if ( i == 0 || (s[i-1] != '<' && s[i-1] != '>') )
+				return CL_BG;
+			break;
+		case '|':
+			if ( i + 1 < len && s[i+1] == '|' ) {
+				*oplenp = 2;
+				return CL_OR;
+			}
+			break;
+		}
+	}
+	*posp = len;
+	return CL_END;
+}
+
+int cl_find(char *line, size_t len)
+/*
+ * purpose: tell a list from a simple command
+ * returns: 1 if the line has an operator or starts with a group, 0 if
+ *          not
+ */
+{
+	size_t	pos = 0, oplen;
+
+	while ( pos < len && is_blank(line[pos]) )
+		pos++;
+	if ( pos < len && opens_group(line, len, pos) )
+		return 1;
+	pos = 0;
+
+	if ( scan_any(line, len, ";&|") == len )
+		return 0;
+	return cl_next(line, len, &pos, &oplen) != CL_END;
+}
+
+static int is_empty(char *s, size_t len)
+{
+	while ( len > 0 && is_blank(*s) )
+		s++, len--;
+	return len == 0;
+}
+
+int cl_split(char *line, size_t len, struct cmdlist *cl)
+/*
+ * purpose: cut line into commands; the parts point into line
+ * returns: the number of commands, -1 for a syntax error, which is
+ *          an operator with no command before it, in cl->parts[cl->n]
+ *    note: cl->parts is grown as needed and kept for the next call.
+ *          A blank command after a final ; or & is dropped.
+ */
+{
+	size_t	pos = 0, start, oplen = 0;
+	int	op, tag;
+
+	cl->n = 0;
+	do {
+		start = pos;
+		op = cl_next(line, len, &pos, &oplen);
+		if ( cl->n == cl->max ) {
+			cl->max = cl->max ? 2 * cl->max : 8;
+			tag = mem_tag(MT_TOKEN);
+			cl->parts = erealloc(cl->parts,
+					cl->max * sizeof(struct cl_part));
+			mem_tag(tag);
+		}
+		cl->parts[cl->n].text = line + start;
+		cl->parts[cl->n].len  = pos - start;
+		cl->parts[cl->n].op   = op;
+		if ( is_empty(line + start, pos - start) ) {
+			if ( op == CL_END && cl->n > 0 )
+				break;
+			if ( op != CL_DSEMI )
+				return -1;		/* parts[n] is the bad one */
+		}
+		cl->n++;
+		pos += oplen;
+	} while ( op != CL_END );
+	return cl->n;
+}
+
+int cl_run(char *line, size_t len)
+/*
+ * purpose: run the commands of a list
+ * returns: the status of the last command run, 2 for a syntax error
+ *  method: take one and-or list at a time. One that ends in & and
+ *          has more than one command is run in a child as a job; a
+ *          single command with & is left to process(). In an if or case,
+ *          cf_scan takes the keywords and the commands not to be run,
+ *          and what is left of the line is run as a list of its own.
+ *          If the line is a script's last, so is the last command of
+ *          its last and-or list, unless that list ends in &. A return
+ *          in a function stops the list where it is.
+ */
+{
+	struct cmdlist cl = { NULL, 0, 0 };
+	int	i, n, pid, fd, rv = 2, last = proc_is_last();
+	size_t	rest, skip;
+
+	proc_last(0);
+	if ( cl_split(line, len, &cl) == -1 )
+		fprintf(stderr, "syntax error: %s unexpected\n",
+				opname[cl.parts[cl.n].op]);
+	else
+		for ( i = 0 ; i < cl.n && !fn_returning() ; i += n ) {
+			rest = line + len - cl.parts[i].text;
+			if ( cf_wants(cl.parts[i].text, rest)
+					&& (skip = cf_scan(cl.parts[i].text, rest)) > 0 ) {
+				if ( skip < rest )	/* dead or keywords before */
+					rv = cl_run(cl.parts[i].text + skip, rest - skip);
+				break;
+			}
+			for ( n = 1 ; cl.parts[i+n-1].op == CL_AND
+					|| cl.parts[i+n-1].op == CL_OR ; n++ )
+				;
+			if ( n == 1 || cl.parts[i+n-1].op != CL_BG ) {
+				rv = run_chain(cl.parts + i, n, last && i + n == cl.n
+						&& cl.parts[i+n-1].op <= CL_SEQ);
+				if ( cl.parts[i+n-1].op == CL_DSEMI )
+					cf_dsemi();
+				continue;
+			}
+			fflush(stdout);
+			if ( (pid = fork()) == -1 ) {
+				perror("fork");
+				rv = 1;
+			}
+			else if ( pid == 0 ) {
+				if ( (fd = open("/dev/null", O_RDONLY)) != -1 ) {
+					dup2(fd, 0);
+					close(fd);
+				}
+				cl.parts[i+n-1].op = CL_END;
+				rv = run_chain(cl.parts + i, n, 0);
+				fflush(stdout);
+				_exit(rv);
+			}
+			else {
+				job_add(pid);
+				rv = 0;
+			}
+		}
+	efree(cl.parts);
+	return rv;
+}
+
+static int run_chain(struct cl_part *p, int n, int last)
+/*
+ * purpose: run an and-or list of n commands, with proc_last on the
+ *          last one if last is set
+ * returns: the status of the last one run
+ *    note: for  if a && b  the whole list is the condition, so the
+ *          if is taken off the first command and given the status
+ *          of the list at the end.
+ */
+{
+	struct cl_part first = p[0];
+	int	i, rv, is_if = 0;
+
+	while ( first.len > 0 && is_blank(*first.text) )
+		first.text++, first.len--;
+	if ( n > 1 && first.len >= 2 && strncmp(first.text, "if", 2) == 0
+			&& (first.len == 2 || is_blank(first.text[2])) ) {
+		if ( cf_if_start() == -1 )
+			return -1;
+		is_if = 1;
+		first.text += 2;
+		first.len  -= 2;
+	}
+	proc_last(last && n == 1);
+	rv = run_part(&first);
+	for ( i = 1 ; i < n && !fn_returning() ; i++ )
+		if ( (p[i-1].op == CL_AND) == (rv == 0) ) {
+			proc_last(last && !is_if && i == n - 1);
+			rv = run_part(&p[i]);
+		}
+	return is_if ? cf_if(rv) : rv;
+}
+
+static int run_group(char *s, size_t len, int op)
+/*
+ * purpose: run the group that starts s, with op the operator after it
+ * returns: the status of its list, 0 if it was put in the background,
+ *          2 for a syntax error
+ *  method: { list; } is cl_run here. ( list ) is cl_run in a fork that
+ *          exits with its status, with the mark for the last command
+ *          on, since nothing comes after it there. A group run with &
+ *          is forked either way. A ( list ) that is the last command of
+ *          the script needs no fork, as the shell ends after it.
+ */
+{
+	size_t	end = group_end(s, len, 0), in;
+	int	last = proc_is_last(), pid, fd, status;
+
+	proc_last(0);
+	for ( in = end - 1 ; end > 0 && in > 1 && is_blank(s[in-1]) ; in-- )
+		;
+	if ( end == 0 || !is_empty(s + end, len - end)
+			|| (*s == '{' && s[in-1] != ';' && s[in-1] != '&') ) {
+		fprintf(stderr, "syntax error: %s\n", end == 0 ?
+				(*s == '(' ? ") expected" : "} expected")
+				: end < len ? "junk after group" : "; expected before }");
+		return 2;
+	}
+	if ( op != CL_BG && (*s == '{' || (last && !jobs_running())) ) {
+		proc_last(last);
+		return cl_run(s + 1, end - 2);
+	}
+	fflush(stdout);
+	if ( (pid = fork()) == -1 ) {
+		perror("fork");
+		return 1;
+	}
+	if ( pid == 0 ) {
+		if ( op == CL_BG && (fd = open("/dev/null", O_RDONLY)) != -1 ) {
+			dup2(fd, 0);
+			close(fd);
+		}
+		proc_last(1);
+		status = cl_run(s + 1, end - 2);
+		fflush(stdout);
+		_exit(status);		/* not exit: leave stdin's offset */
+	}
+	if ( op == CL_BG ) {
+		job_add(pid);
+		return 0;
+	}
+	while ( waitpid(pid, &status, 0) == -1 )
+		if ( errno != EINTR ) {
+			perror("wait");
+			return 1;
+		}
+	return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+static int run_part(struct cl_part *p)
+/*
+ * purpose: expand, split and run one command of a list
+ * returns: its status, which is also made $? for the next one
+ */
+{
+	char	**args;
+	size_t	skip;
+	int	n, tag, rv = VLstatus();
+
+	for ( skip = 0 ; skip < p->len && is_blank(p->text[skip]) ; skip++ )
+		;
+	if ( skip < p->len && opens_group(p->text, p->len, skip) ) {
+		rv = run_group(p->text + skip, p->len - skip, p->op);
+		VLsetstatus(rv);
+		return rv;
+	}
+	if ( is_empty(p->text, p->len)
+			|| (args = parse_line(p->text, p->len)) == NULL )
+		return rv;
+	if ( p->op == CL_BG ) {			/* process() sees the & */
+		for ( n = 0 ; args[n] != NULL ; n++ )
+			;
+		tag = mem_tag(MT_TOKEN);
+		args = erealloc(args, (n + 2) * sizeof(char *));
+		args[n] = newstr("&", 1);
+		args[n+1] = NULL;
+		mem_tag(tag);
+	}
+	rv = execute_args(args);
+	freelist(args);
+	VLsetstatus(rv);
+	return rv;
+}
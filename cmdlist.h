@@ -0,0 +1,26 @@
+#ifndef	CMDLIST_H
+#define	CMDLIST_H
+/*
+ * header for cmdlist.c - command lists with ; && || & and ;;
+ */
+#include	<stddef.h>
+
+enum cl_ops { CL_END, CL_SEQ, CL_AND, CL_OR, CL_BG, CL_DSEMI };
+
+struct cl_part {			/* one command of a list	*/
+	char	*text;			/* raw, not expanded		*/
+	size_t	len;
+	int	op;			/* the operator after it	*/
+};
+
+struct cmdlist {
+	struct cl_part *parts;
+	int	n, max;
+};
+
+int	cl_find(char *, size_t);
+int	cl_next(char *, size_t, size_t *, size_t *);
+int	cl_split(char *, size_t, struct cmdlist *);
+int	cl_run(char *, size_t);
+
+#endif
@@ -0,0 +1,342 @@
+/* cond.c - the [[ ... ]] conditional
+ *
+ *    exec_cond( args )    run [[ expr ]], 0 if true, 1 if false, 2 for
+ *                         an error
+ *
+ *  expr is made of
+ *      word                  true if word is not empty
+ *      -z word, -n word      word is empty, is not empty
+ *      -e -f -d file         file exists, is a regular file, a directory
+ *      a == pat, a != pat    a matches the pattern pat, does not; = is ==
+ *      a =~ re               a matches the extended regular expression re
+ *      a -eq b  ...          -eq -ne -lt -le -gt -ge compare a and b as
+ *                            arithmetic expressions
+ *      ! expr, ( expr ), expr && expr, expr || expr
+ *  && binds tighter than ||, and the right side of either is only
+ *  evaluated if it is needed. cl_next does not cut a line on && or ||
+ *  inside [[ ]], and the words are not globbed.
+ *
+ *  smsh has no quotes, so an empty $var leaves no word behind: an
+ *  operator with nothing on one side takes the empty string there.
+ *
+ *  after =~ BASH_REMATCH is the array of the whole match and the
+ *  groups, empty if there was no match. Compiled regexes are kept in
+ *  a cache of MAXREGEX entries, hashed on the pattern text and in least
+ *  recently used order, so a test in a loop compiles its pattern once;
+ *  when the cache is full the one used longest ago is dropped.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<regex.h>
+#include	<sys/stat.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"varlib.h"
+#include	"match.h"
+#include	"arith.h"
+#include	"cond.h"
+
+#define	NBUCKETS	64
+#define	MAXREGEX	32
+
+struct rx {
+		char	*src;		/* the pattern			*/
+		regex_t	re;
+		struct rx *next;	/* hash chain			*/
+		struct rx *newer;	/* the LRU list			*/
+		struct rx *older;
+	};
+
+static struct rx *table[NBUCKETS];
+static struct rx *newest = NULL, *oldest = NULL;
+static int	nrx = 0;
+
+struct cond {
+		char	**w;		/* the next word		*/
+		int	skip;		/* > 0: parse, do not evaluate	*/
+		int	err;		/* 2 after an error		*/
+	};
+
+static int	or_expr(struct cond *);
+
+static unsigned rx_hash(char *s)
+{
+	unsigned h = 0;
+
+	while ( *s )
+		h = h * 31 + (unsigned char) *s++;
+	return h % NBUCKETS;
+}
+
+static void rx_unlist(struct rx *r)
+{
+	if ( r->newer )
+		r->newer->older = r->older;
+	else
+		newest = r->older;
+	if ( r->older )
+		r->older->newer = r->newer;
+	else
+		oldest = r->newer;
+}
+
+static void rx_front(struct rx *r)
+{
+	r->newer = NULL;
+	r->older = newest;
+	if ( newest )
+		newest->newer = r;
+	newest = r;
+	if ( oldest == NULL )
+		oldest = r;
+}
+
+static void rx_drop(struct rx *r)
+/*
+ * take the least recently used regex out of the cache
+ */
+{
+	struct rx **rp = &table[rx_hash(r->src)];
+
+	while ( *rp != r )
+		rp = &(*rp)->next;
+	*rp = r->next;
+	rx_unlist(r);
+	regfree(&r->re);
+	efree(r->src);
+	efree(r);
+	nrx--;
+}
+
+static regex_t *rx_lookup(char *pat)
+/*
+ * purpose: the compiled form of pat, from the cache or made now
+ * returns: NULL after a message if pat is not a good regex
+ */
+{
+	struct rx *r;
+	unsigned h = rx_hash(pat);
+	char	msg[128];
+	int	e, tag;
+
+	for ( r = table[h] ; r != NULL ; r = r->next )
+		if ( strcmp(r->src, pat) == 0 ) {
+			if ( r != newest ) {
+				rx_unlist(r);
+				rx_front(r);
+			}
+			return &r->re;
+		}
+	tag = mem_tag(MT_OTHER);
+	r = emalloc(sizeof(struct rx));
+	if ( (e = regcomp(&r->re, pat, REG_EXTENDED)) != 0 ) {
+		regerror(e, &r->re, msg, sizeof(msg));
+		fprintf(stderr, "[[: %s: %s\n", pat, msg);
+		efree(r);
+		mem_tag(tag);
+		return NULL;
+	}
+	if ( nrx == MAXREGEX )
+		rx_drop(oldest);
+	r->src = newstr(pat, strlen(pat));
+	mem_tag(tag);
+	r->next = table[h];
+	table[h] = r;
+	rx_front(r);
+	nrx++;
+	return &r->re;
+}
+
+static int rx_match(struct cond *cp, char *s, char *pat)
+/*
+ * purpose: s =~ pat, and set BASH_REMATCH
+ * returns: 1 for a match, 0 for none
+ */
+{
+	regex_t	*re;
+	regmatch_t *m;
+	char	**v;
+	int	i, n = 0, tag;
+
+	if ( (re = rx_lookup(pat)) == NULL ) {
+		cp->err = 2;
+		return 0;
+	}
+	tag = mem_tag(MT_VARLIB);
+	m = emalloc((re->re_nsub + 1) * sizeof(regmatch_t));
+	v = emalloc((re->re_nsub + 1) * sizeof(char *));
+	if ( regexec(re, s, re->re_nsub + 1, m, 0) == 0 )
+		for ( n = 0 ; n <= (int) re->re_nsub ; n++ ) {
+			i = ( m[n].rm_so == -1 ? 0 : m[n].rm_eo - m[n].rm_so );
+			v[n] = newstr(s + m[n].rm_so * (i > 0), i);
+		}
+	efree(m);
+	mem_tag(tag);
+	VLsetarray("BASH_REMATCH", v, n, NULL, 0);
+	return n > 0;
+}
+
+static int is_end(char *w)
+{
+	return w == NULL || strcmp(w, "]]") == 0 || strcmp(w, "&&") == 0
+		|| strcmp(w, "||") == 0 || strcmp(w, ")") == 0;
+}
+
+static int is_unary(char *w)
+{
+	return w != NULL && w[0] == '-' && w[1] != '\0'
+		&& strchr("znefd", w[1]) != NULL && w[2] == '\0';
+}
+
+static int is_binary(char *w)
+{
+	static char *ops[] = { "=~", "==", "=", "!=", "-eq", "-ne", "-lt",
+				"-le", "-gt", "-ge", NULL };
+	int	i;
+
+	for ( i = 0 ; w != NULL && ops[i] != NULL ; i++ )
+		if ( strcmp(w, ops[i]) == 0 )
+			return 1;
+	return 0;
+}
+
+static char *operand(struct cond *cp)
+/*
+ * the next word, or "" if an empty $var left nothing there
+ */
+{
+	return ( is_end(*cp->w) ? "" : *cp->w++ );
+}
+
+static int unary(char *op, char *s)
+{
+	struct stat info;
+
+	switch ( op[1] ) {
+	case 'z':
+		return *s == '\0';
+	case 'n':
+		return *s != '\0';
+	}
+	if ( stat(s, &info) == -1 )
+		return 0;
+	return op[1] == 'e' || (op[1] == 'f' && S_ISREG(info.st_mode))
+		|| (op[1] == 'd' && S_ISDIR(info.st_mode));
+}
+
+static int binary(struct cond *cp, char *a, char *op, char *b)
+{
+	int64_t	x, y;
+
+	if ( strcmp(op, "=~") == 0 )
+		return rx_match(cp, a, b);
+	if ( op[0] == '=' )
+		return pmatch(b, a);
+	if ( op[0] == '!' )
+		return !pmatch(b, a);
+	if ( arith_eval(a, &x) != 0 || arith_eval(b, &y) != 0 ) {
+		cp->err = 2;
+		return 0;
+	}
+	switch ( op[1] * 256 + op[2] ) {
+	case 'e' * 256 + 'q':	return x == y;
+	case 'n' * 256 + 'e':	return x != y;
+	case 'l' * 256 + 't':	return x < y;
+	case 'l' * 256 + 'e':	return x <= y;
+	case 'g' * 256 + 't':	return x > y;
+	}
+	return x >= y;
+}
+
+static int primary(struct cond *cp)
+/*
+ * ! primary, ( expr ), or one test
+ */
+{
+	char	*a, *b, *op;
+	int	rv;
+
+	if ( *cp->w != NULL && strcmp(*cp->w, "!") == 0 ) {
+		cp->w++;
+		return !primary(cp);
+	}
+	if ( *cp->w != NULL && strcmp(*cp->w, "(") == 0 ) {
+		cp->w++;
+		rv = or_expr(cp);
+		if ( *cp->w == NULL || strcmp(*cp->w, ")") != 0 ) {
+			fprintf(stderr, "[[: ) expected\n");
+			cp->err = 2;
+		}
+		else
+			cp->w++;
+		return rv;
+	}
+	if ( is_end(*cp->w) ) {
+		fprintf(stderr, "[[: expression expected\n");
+		cp->err = 2;
+		return 0;
+	}
+	if ( is_unary(*cp->w) && !is_binary(cp->w[1]) ) {
+		op = *cp->w++;
+		a = operand(cp);
+		return cp->skip ? 0 : unary(op, a);
+	}
+	if ( is_binary(*cp->w) && !is_end(cp->w[1]) && !is_binary(cp->w[1]) )
+		a = "";				/* nothing on the left	*/
+	else
+		a = *cp->w++;
+	if ( !is_binary(*cp->w) )
+		return *a != '\0';
+	op = *cp->w++;
+	b = operand(cp);
+	return cp->skip ? 0 : binary(cp, a, op, b);
+}
+
+static int and_expr(struct cond *cp)
+{
+	int	rv = primary(cp), r;
+
+	while ( *cp->w != NULL && strcmp(*cp->w, "&&") == 0 ) {
+		cp->w++;
+		cp->skip += !rv;		/* false already	*/
+		r = primary(cp);
+		cp->skip -= !rv;
+		rv = rv && r;
+	}
+	return rv;
+}
+
+static int or_expr(struct cond *cp)
+{
+	int	rv = and_expr(cp), r;
+
+	while ( *cp->w != NULL && strcmp(*cp->w, "||") == 0 ) {
+		cp->w++;
+		cp->skip += rv;			/* true already		*/
+		r = and_expr(cp);
+		cp->skip -= rv;
+		rv = rv || r;
+	}
+	return rv;
+}
+
+int exec_cond(char **args)
+/*
+ * purpose: the [[ builtin
+ * returns: 0 if the expression is true, 1 if false, 2 for an error
+ */
+{
+	struct cond c = { args + 1, 0, 0 };
+	int	rv;
+
+	rv = or_expr(&c);
+	if ( c.err == 0 && (*c.w == NULL || strcmp(*c.w, "]]") != 0
+						|| c.w[1] != NULL) ) {
+		fprintf(stderr, "[[: %s\n", *c.w ? "syntax error" : "]] expected");
+		c.err = 2;
+	}
+	return c.err ? c.err : !rv;
+}
@@ -0,0 +1,9 @@
+#ifndef	COND_H
+#define	COND_H
+/*
+ * header for cond.c - the [[ ... ]] conditional
+ */
+
+int	exec_cond(char **);
+
+#endif
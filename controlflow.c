@@ -1,52 +1,146 @@
 /* controlflow.c
  *
- * "if" processing is done with two state variables
- *    if_state and if_result
+ * "if" processing is done with a stack of frames, one for each open
+ * if. A frame holds the state (waiting for then, in the then block,
+ * in the else block) and the result of the condition, and whether
+ * the block around the if was running when it was opened, so an if
+ * inside a branch that is not taken is never taken either and nesting
+ * costs nothing to check.
+ *
+ * lines in a branch that is not taken are not expanded: cf_scan looks
+ * only at the first word of each command for the keywords.
+ *
+ * a case is a frame too. Its word is expanded when the case is read,
+ * then each clause's  pat|pat)  is matched against it (case.c) until
+ * one matches; that clause's commands run up to its ;; and the rest
+ * are skipped up to esac, all by cf_scan.
  */
 #include	<stdio.h>
 #include 	<string.h>
 #include	<stdlib.h>
 #include	"smsh.h"
 #include	"process.h"
+#include	"controlflow.h"
+#include	"builtin.h"
+#include	"cmdlist.h"
+#include	"case.h"
+#include	"splitline.h"
+#include	"varlib.h"
 
-enum states   { NEUTRAL, WANT_THEN, THEN_BLOCK, WANT_ELSE, ELSE_BLOCK };
+enum states   { WANT_THEN, THEN_BLOCK, ELSE_BLOCK,		/* if	*/
+		WANT_PAT, IN_BODY, SKIP_BODY, CASE_DONE };	/* case	*/
 enum results  { SUCCESS, FAIL };
+enum keywords { KW_IF, KW_THEN, KW_ELSE, KW_FI, KW_CASE, KW_ESAC };
+
+struct frame {
+	int	state;
+	int	result;
+	int	live;			/* the block around it runs	*/
+	char	*word;			/* of a case, expanded		*/
+	size_t	wlen;
+};
+
+#define	is_case(fp)	((fp)->state >= WANT_PAT)
 
-static int if_state  = NEUTRAL;
-static int if_result = SUCCESS;
+static struct frame *stack = NULL;
+static int depth = 0, maxdepth = 0;
+static int base = 0;			/* frames below are a caller's	*/
 static int last_stat = 0;
 
-int	syn_err(char *);
+#define	is_blank(c)	((c) == ' ' || (c) == '\t')
+
+static int runs(struct frame *fp)
+/*
+ * is the block we are in, inside frame fp, being run?
+ */
+{
+	if ( is_case(fp) )
+		return fp->live && fp->state == IN_BODY;
+	return fp->live && fp->state != WANT_THEN
+		&& (fp->state == THEN_BLOCK) == (fp->result == SUCCESS);
+}
 
 int ok_to_execute()
 /*
  * purpose: determine the shell should execute a command
  * returns: 1 for yes, 0 for no
- * details: if in THEN_BLOCK and if_result was SUCCESS then yes
- *          if in THEN_BLOCK and if_result was FAIL    then no
- *          if in WANT_THEN  then syntax error (sh is different)
+ * details: outside any if yes. Inside one, the top frame says: no if
+ *          its if was in a block not taken, a syntax error if it is
+ *          waiting for then, and otherwise yes for the then block of
+ *          a condition that succeeded or the else block of one that
+ *          failed, or for the clause of a case that matched.
  */
 {
-	int	rv = 1;		/* default is positive */
-	
-	if ( if_state == WANT_THEN ){
+	struct frame *fp;
+
+	if ( depth == base )
+		return 1;
+	fp = &stack[depth-1];
+	if ( fp->live && fp->state == WANT_THEN ) {
 		syn_err("then expected");
-		rv = 0;
-	}
-	else if ( if_state == THEN_BLOCK && if_result == SUCCESS ) {
-		rv = 1; 
-	}
-	else if ( if_state == THEN_BLOCK && if_result == FAIL ) {
-		rv = 0; 
+		return 0;
 	}
-	else if ( if_state == ELSE_BLOCK && if_result == SUCCESS ) {
-		rv = 0; 
-	}
-	else if ( if_state == ELSE_BLOCK && if_result == FAIL ) {
-		rv = 1; 
+	return runs(fp);
+}
+
+int cf_dead()
+/*
+ * purpose: are we in a block that is not run? Like ok_to_execute but
+ *          with no complaint about a missing then
+ * returns: 1 for yes, 0 for no
+ */
+{
+	return depth > base && !runs(&stack[depth-1])
+		&& !(stack[depth-1].live && stack[depth-1].state == WANT_THEN);
+}
+
+int cf_wants(char *line, size_t len)
+/*
+ * purpose: does the line need cf_scan before it is run?
+ * returns: 1 if an if or case is open or the line starts a case
+ */
+{
+	if ( depth > base )
+		return 1;
+	while ( len > 0 && is_blank(*line) )
+		line++, len--;
+	return len >= 4 && strncmp(line, "case", 4) == 0
+		&& (len == 4 || is_blank(line[4]));
+}
+
+static void push(int state, int result, int live)
+{
+	int	tag;
+
+	if ( depth == maxdepth ) {
+		maxdepth = maxdepth ? 2 * maxdepth : 16;
+		tag = mem_tag(MT_OTHER);
+		stack = erealloc(stack, maxdepth * sizeof(struct frame));
+		mem_tag(tag);
 	}
+	stack[depth].state  = state;
+	stack[depth].result = result;
+	stack[depth].live   = live;
+	stack[depth].word   = NULL;
+	stack[depth].wlen   = 0;
+	depth++;
+}
 
-	return rv;
+static void pop_to(int d)
+{
+	while ( depth > d )
+		efree(stack[--depth].word);
+}
+
+static void push_case(char *word)
+/*
+ * a case whose word, expanded, is word. Takes it over
+ */
+{
+	push(WANT_PAT, SUCCESS, 1);
+	mem_retag(word, MT_OTHER);
+	stack[depth-1].word = word;
+	stack[depth-1].wlen = strlen(word);
 }
 
 int is_control_command(char *s)
@@ -55,89 +149,299 @@ int is_control_command(char *s)
  * returns: 0 or 1
  */
 {
-    return (
-		strcmp(s, "if")   == 0 ||
-		strcmp(s, "then") == 0 ||
-		strcmp(s, "else") == 0 ||
-		strcmp(s, "fi")   == 0
-	);
+	struct builtin *cmd = cmd_lookup(s);
+
+	return cmd != NULL && cmd->kind == CMD_KEYWORD;
+}
+
+static int keyword(char *w, size_t len)
+/*
+ * returns the KW_ number of the word w of len chars, -1 if none
+ */
+{
+	static char *names[] = { "if", "then", "else", "fi", "case", "esac" };
+	int	i;
+
+	for ( i = 0 ; i < 6 ; i++ )
+		if ( strlen(names[i]) == len && strncmp(w, names[i], len) == 0 )
+			return i;
+	return -1;
+}
+
+static int move(int kw)
+/*
+ * purpose: the change of state for a keyword. An if or case here is
+ *          one in a block that is not taken, so nothing of it is run
+ * returns: 0 if ok, -1 for syntax error
+ */
+{
+	struct frame *fp = ( depth > base ? &stack[depth-1] : NULL );
+
+	switch ( kw ) {
+	case KW_IF:
+		push(WANT_THEN, FAIL, 0);
+		return 0;
+	case KW_CASE:
+		push(WANT_PAT, FAIL, 0);
+		return 0;
+	case KW_THEN:
+		if ( fp == NULL || fp->state != WANT_THEN )
+			return syn_err("then unexpected");
+		fp->state = THEN_BLOCK;
+		return 0;
+	case KW_ELSE:
+		if ( fp == NULL || fp->state != THEN_BLOCK )
+			return syn_err("else unexpected");
+		fp->state = ELSE_BLOCK;
+		return 0;
+	case KW_FI:
+		if ( fp == NULL || is_case(fp) || fp->state == WANT_THEN )
+			return syn_err("fi unexpected");
+		pop_to(depth - 1);
+		return 0;
+	case KW_ESAC:
+		if ( fp == NULL || !is_case(fp) )
+			return syn_err("esac unexpected");
+		pop_to(depth - 1);
+		return 0;
+	}
+	return -1;
 }
 
+int cf_dsemi()
+/*
+ * purpose: the ;; that ends a clause of a case
+ * returns: 0 if ok, -1 for syntax error
+ */
+{
+	struct frame *fp = ( depth > base ? &stack[depth-1] : NULL );
+
+	if ( fp == NULL || !is_case(fp) || fp->state == WANT_PAT )
+		return syn_err(";; unexpected");
+	if ( fp->state == IN_BODY )
+		fp->state = CASE_DONE;		/* skip to esac	*/
+	else if ( fp->state == SKIP_BODY )
+		fp->state = WANT_PAT;
+	return 0;
+}
+
+static size_t open_case(char *line, size_t i, size_t end)
+/*
+ * purpose: the rest of  case word in  from i. The word is expanded
+ *          unless the case is in a block not taken
+ * returns: the index after the in
+ */
+{
+	size_t	w, wl;
+	char	*val;
+
+	for ( ; i < end && is_blank(line[i]) ; i++ )
+		;
+	for ( w = i ; i < end && !is_blank(line[i]) ; i++ )
+		;
+	wl = i - w;
+	for ( ; i < end && is_blank(line[i]) ; i++ )
+		;
+	if ( wl == 0 || end - i < 2 || strncmp(line + i, "in", 2) != 0
+			|| (i + 2 < end && !is_blank(line[i+2])) ) {
+		syn_err("in expected");
+		return end;
+	}
+	if ( cf_dead() )
+		move(KW_CASE);
+	else {
+		if ( (val = substitute_variables(line + w, wl)) == NULL )
+			val = newstr(line + w, wl);
+		push_case(val);
+	}
+	return i + 2;
+}
+
+static size_t clause(char *line, size_t i, size_t end)
+/*
+ * purpose: the  pat|pat)  of a clause, at i, for the case on top
+ * returns: the index after the )
+ */
+{
+	struct frame *fp = &stack[depth-1];
+	size_t	close;
+
+	if ( line[i] == '(' )
+		i++;
+	for ( close = i ; close < end && line[close] != ')' ; close++ )
+		if ( line[close] == '\\' )
+			close++;
+	if ( close >= end ) {
+		syn_err(") expected");
+		return end;
+	}
+	if ( fp->live && case_match(fp->word, fp->wlen, line + i, close - i) )
+		fp->state = IN_BODY;
+	else
+		fp->state = SKIP_BODY;
+	return close + 1;
+}
 
 int do_control_command(char **args)
 /*
- * purpose: Process "if", "then", "fi" - change state or detect error
+ * purpose: Process "if", "then", "else", "fi", "case", "esac" - change
+ *          state or detect error. A command after then or else is run
+ *          (or not) after the change
  * returns: 0 if ok, -1 for syntax error
  *   notes: I would have put returns all over the place, Barry says "no"
  */
 {
 	char	*cmd = args[0];
+	int	kw = keyword(cmd, strlen(cmd));
 	int	rv = -1;
 
-	if( strcmp(cmd,"if")==0 ){
-		if ( if_state != NEUTRAL )
-			rv = syn_err("if unexpected");
-		else {
-			last_stat = process(args+1);
-			if_result = (last_stat == 0 ? SUCCESS : FAIL );
-			if_state = WANT_THEN;
-			rv = 0;
-		}
+	if ( kw == KW_IF ) {
+		if ( (rv = cf_if_start()) == 0 )
+			rv = ( ok_to_execute() ? cf_if(process(args+1)) : move(kw) );
 	}
-	else if ( strcmp(cmd,"then")==0 ){
-		if ( if_state != WANT_THEN )
-			rv = syn_err("then unexpected");
+	else if ( kw == KW_CASE ) {		/* not seen by cf_scan	*/
+		if ( args[1] == NULL || args[2] == NULL || args[3] != NULL
+				|| strcmp(args[2], "in") != 0 )
+			rv = syn_err("in expected");
+		else if ( cf_dead() )
+			rv = move(kw);
 		else {
-			if_state = THEN_BLOCK;
+			push_case(newstr(args[1], strlen(args[1])));
 			rv = 0;
 		}
 	}
-	else if ( strcmp(cmd,"else")==0 ){
-		if ( if_state == NEUTRAL || 
-			 if_state == WANT_THEN || 
-			 if_state == ELSE_BLOCK 
-		) { 
-			rv = syn_err("else unexpected");
-		}
-		if_state = ELSE_BLOCK;
-		rv = 0;
+	else if ( kw != -1 ) {
+		if ( (rv = move(kw)) == 0 && args[1] != NULL && kw != KW_FI )
+			rv = process(args+1);		/* then cmd	*/
 	}
-	else if ( strcmp(cmd,"fi")==0 ){ 
-		// These are incorrect states for the fi token
-		if ( if_state == NEUTRAL || if_state == WANT_THEN) { 
-			rv = syn_err("fi unexpected");
+	else
+		fatal("internal error processing:", cmd, 2);
+
+	return rv;
+}
+
+int cf_if_start()
+/*
+ * purpose: check that an if may start here, before its condition runs
+ * returns: 0 if ok, -1 for syntax error
+ */
+{
+	if ( depth > base && stack[depth-1].state == WANT_THEN )
+		return syn_err("if unexpected");
+	return 0;
+}
+
+int cf_if(int status)
+/*
+ * purpose: an if whose condition has been run and returned status.
+ *          Used for a plain if and for  if a && b  from cmdlist.c
+ * returns: 0
+ */
+{
+	last_stat = status;
+	push(WANT_THEN, last_stat == 0 ? SUCCESS : FAIL, 1);
+	return 0;
+}
+
+size_t cf_scan(char *line, size_t len)
+/*
+ * purpose: go over the commands at the start of line that are only
+ *          keywords or are in a block that is not run, so that none
+ *          of them is expanded or split
+ * returns: where the rest of the line, to be run as usual, starts;
+ *          len if there is nothing left to run
+ *  method: cl_next finds the end of each command; its first word is
+ *          checked for a keyword. A live if stops the scan since its
+ *          condition has to run. A case waiting for a clause takes the
+ *          command as a pattern list. A command after then, else, a
+ *          pattern's ) or case ... in starts with the word after it.
+ */
+{
+	size_t	pos = 0, end, oplen, w, wlen;
+	int	op, kw;
+
+	while ( pos < len ) {
+		end = pos;
+		op = cl_next(line, len, &end, &oplen);
+		for ( w = pos ; w < end && is_blank(line[w]) ; w++ )
+			;
+		for ( wlen = 0 ; w + wlen < end && !is_blank(line[w+wlen]) ; wlen++ )
+			;
+		kw = keyword(line + w, wlen);
+		if ( w == end )
+			;				/* empty, before ;; */
+		else if ( depth > base && stack[depth-1].state == WANT_PAT
+				&& kw != KW_ESAC )
+			w = clause(line, w, end);
+		else if ( kw == KW_CASE )
+			w = open_case(line, w + wlen, end);
+		else if ( kw == -1 || kw == KW_IF ) {
+			if ( !cf_dead() )
+				break;			/* runs as usual */
+			if ( kw == KW_IF )
+				move(kw);
+			w = end;
 		}
 		else {
-			if_state = NEUTRAL;
-			rv = 0;
+			move(kw);
+			w += wlen;
 		}
+		for ( ; w < end && is_blank(line[w]) ; w++ )
+			;
+		if ( w < end ) {			/* then cmd	*/
+			pos = w;
+			if ( !cf_dead() )
+				break;
+			continue;
+		}
+		if ( op == CL_DSEMI )
+			cf_dsemi();
+		pos = ( op == CL_END ? len : end + oplen );
 	}
-	else 
-		fatal("internal error processing:", cmd, 2);
-	
-	return rv;
+	return pos;
 }
 
 int syn_err(char *msg)
 /* purpose: handles syntax errors in control structures
- * details: resets state to NEUTRAL
+ * details: drops the open ifs of this level
  * returns: -1 in interactive mode. Should call fatal in scripts
  */
 {
-	if_state = NEUTRAL;
+	pop_to(base);
 	fprintf(stderr,"syntax error: %s\n", msg);
 	return -1;
 }
 
 void check_if_state(char *filename, int line_number)
 /*
- * checks to make sure the if_state is in neutral when reaching the
+ * checks to make sure no if or case is left open when reaching the
  * EOF function. Otherwise there's a syntax error.
  */
 {
-	if ( if_state == NEUTRAL ) return ; /* NEUTRAL is the expected state at EOF*/ 
+	if ( depth == base ) return ; /* no open if is the expected state at EOF*/
 
 	fprintf(stderr, "%s: line %d: ", filename, line_number);
 	syn_err("unexpected end of file");
 	exit(2);
-}
\ No newline at end of file
+}
+
+void cf_save(struct cf_context *cp)
+/*
+ * starts a new level on top of the open ifs. Used around function
+ * calls so the body can have its own if blocks.
+ */
+{
+	cp->base  = base;
+	cp->depth = depth;
+	base = depth;
+}
+
+void cf_restore(struct cf_context *cp)
+/*
+ * goes back to the level saved by cf_save. An if left open by
+ * the body (say by a return inside it) is dropped.
+ */
+{
+	pop_to(cp->depth);
+	base  = cp->base;
+}
@@ -1,8 +1,28 @@
 /*
  * controlflow.h
  */
+#ifndef	CONTROLFLOW_H
+#define	CONTROLFLOW_H
+
+#include	<stddef.h>
+
+struct cf_context {			/* saved by cf_save	*/
+	int	base;
+	int	depth;
+};
+
 int is_control_command(char *);
 int do_control_command(char **);
 int ok_to_execute();
+int cf_dead();
+int cf_wants(char *, size_t);
+int cf_dsemi();
+size_t cf_scan(char *, size_t);
+int cf_if_start();
+int cf_if(int);
 void check_if_state(char*, int);
-void syn_err(char *);
+int syn_err(char *);
+void cf_save(struct cf_context *);
+void cf_restore(struct cf_context *);
+
+#endif
@@ -0,0 +1,200 @@
+/* coproc.c - coprocesses
+ *
+ *    exec_coproc( args )   coproc NAME command [args...]: start command
+ *                          with a pipe to its stdin and one from its
+ *                          stdout, and leave it running
+ *                          coproc -c NAME: close the pipe to NAME, so
+ *                          it sees the end of its input
+ *
+ *  NAME becomes the array ( rfd wfd ): read -u ${NAME[0]} takes a line
+ *  of what the command writes, and print -u ${NAME[1]} sends it one.
+ *  NAME_PID is its pid, and it is a job like one run with &, so $! is
+ *  set, wait $NAME_PID waits for it, and jobs_reap collects it when it
+ *  ends. A helper that answers a line per line it reads is started
+ *  once and serves every request of a script, a write and a read each,
+ *  instead of a fork and exec each.
+ *
+ *  the shell's ends of the pipes are close on exec, so programs run
+ *  later do not hold them open. Starting a coproc under a NAME in use
+ *  closes the old one's pipes first. The read end is left open when
+ *  the command ends, so what it wrote last can still be read.
+ *
+ *  a function or builtin run as a coproc is not exec'd, so close on
+ *  exec does nothing for it: the child closes every one of those ends
+ *  itself, or coproc -c could not bring another coproc to its end of
+ *  input, and it would hold its own input open.
+ */
+
+#define	_GNU_SOURCE
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"varlib.h"
+#include	"builtin.h"
+#include	"process.h"
+#include	"jobs.h"
+#include	"memstat.h"
+#include	"coproc.h"
+
+struct coproc {
+		char	*name;
+		pid_t	pid;
+		int	rfd;		/* from its stdout, -1 if closed */
+		int	wfd;		/* to its stdin, -1 if closed	*/
+	};
+
+static struct coproc *cps = NULL;
+static int	ncps = 0, maxcps = 0;
+
+static struct coproc *cp_find(char *name)
+{
+	int	i;
+
+	for ( i = 0 ; i < ncps ; i++ )
+		if ( strcmp(cps[i].name, name) == 0 )
+			return &cps[i];
+	return NULL;
+}
+
+static int *open_fds(int rfd, int wfd, int *np)
+/*
+ * purpose: list the shell's ends of the pipes of every coproc, with
+ *          rfd and wfd, the ends of the new one's
+ * returns: a malloced list, with its length in *np
+ */
+{
+	int	*fds, i, n = 0, tag = mem_tag(MT_JOBS);
+
+	fds = emalloc((2 * ncps + 2) * sizeof(int));
+	mem_tag(tag);
+	fds[n++] = rfd;
+	fds[n++] = wfd;
+	for ( i = 0 ; i < ncps ; i++ ) {
+		if ( cps[i].rfd != -1 )
+			fds[n++] = cps[i].rfd;
+		if ( cps[i].wfd != -1 )
+			fds[n++] = cps[i].wfd;
+	}
+	*np = n;
+	return fds;
+}
+
+static void set_fds(struct coproc *cp)
+/*
+ * NAME=( rfd wfd )
+ */
+{
+	char	num[24], **v;
+	int	tag = mem_tag(MT_VARLIB);
+
+	v = emalloc(2 * sizeof(char *));
+	snprintf(num, sizeof(num), "%d", cp->rfd);
+	v[0] = newstr(num, strlen(num));
+	snprintf(num, sizeof(num), "%d", cp->wfd);
+	v[1] = newstr(num, strlen(num));
+	mem_tag(tag);
+	VLsetarray(cp->name, v, 2, NULL, 0);
+}
+
+static void set_pid(struct coproc *cp)
+{
+	char	var[256], num[24];
+
+	snprintf(var, sizeof(var), "%s_PID", cp->name);
+	snprintf(num, sizeof(num), "%d", (int) cp->pid);
+	VLstore(var, num);
+}
+
+static int close_coproc(char *cmd, char *name)
+/*
+ * coproc -c NAME: close the pipe to it, NAME[1] becomes -1
+ */
+{
+	struct coproc *cp = cp_find(name);
+
+	if ( cp == NULL ) {
+		fprintf(stderr, "%s: %s: no such coprocess\n", cmd, name);
+		return 1;
+	}
+	if ( cp->wfd != -1 ) {
+		close(cp->wfd);
+		cp->wfd = -1;
+		set_fds(cp);
+	}
+	return 0;
+}
+
+int exec_coproc(char **args)
+/*
+ * purpose: the coproc builtin
+ * returns: 0 if the command was started, 1 if not, 2 for bad usage
+ */
+{
+	struct coproc *cp;
+	char	*cmd = args[0];
+	int	to[2], from[2], tag, *shut, nshut;
+	pid_t	pid;
+
+	if ( args[1] != NULL && strcmp(args[1], "-c") == 0 && args[2] != NULL
+			&& args[3] == NULL )
+		return close_coproc(cmd, args[2]);
+	if ( args[1] == NULL || args[1][0] == '-' || args[2] == NULL ) {
+		fprintf(stderr, "usage: %s NAME command [args...]\n"
+				"       %s -c NAME\n", cmd, cmd);
+		return 2;
+	}
+	if ( !okname(args[1]) || strlen(args[1]) > 200 ) {
+		fprintf(stderr, "%s: %s: not a valid identifier\n", cmd, args[1]);
+		return 2;
+	}
+	if ( pipe2(to, O_CLOEXEC) == -1 ) {
+		perror(cmd);
+		return 1;
+	}
+	if ( pipe2(from, O_CLOEXEC) == -1 ) {
+		perror(cmd);
+		close(to[0]);
+		close(to[1]);
+		return 1;
+	}
+	shut = open_fds(from[0], to[1], &nshut);
+	pid = start_coproc(args + 2, cmd_lookup(args[2]), to[0], from[1],
+								shut, nshut);
+	efree(shut);
+	close(to[0]);
+	close(from[1]);
+	if ( pid == -1 ) {
+		close(to[1]);
+		close(from[0]);
+		return 1;
+	}
+	job_add(pid);
+
+	if ( (cp = cp_find(args[1])) != NULL ) {	/* NAME again	*/
+		if ( cp->rfd != -1 )
+			close(cp->rfd);
+		if ( cp->wfd != -1 )
+			close(cp->wfd);
+	}
+	else {
+		tag = mem_tag(MT_JOBS);
+		if ( ncps == maxcps ) {
+			maxcps = maxcps ? 2 * maxcps : 4;
+			cps = erealloc(cps, maxcps * sizeof(struct coproc));
+		}
+		cp = &cps[ncps++];
+		cp->name = newstr(args[1], strlen(args[1]));
+		mem_tag(tag);
+	}
+	cp->pid = pid;
+	cp->rfd = from[0];
+	cp->wfd = to[1];
+	set_fds(cp);
+	set_pid(cp);
+	return 0;
+}
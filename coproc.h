@@ -0,0 +1,9 @@
+#ifndef	COPROC_H
+#define	COPROC_H
+/*
+ * header for coproc.c - coprocesses
+ */
+
+int	exec_coproc(char **);
+
+#endif
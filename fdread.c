@@ -0,0 +1,232 @@
+/* fdread.c - input for the read builtin
+ *
+ *    fdr_read( fd, delim, max, &out )  append to out what comes on fd
+ *                                      before the next delim, at most
+ *                                      max chars if max >= 0
+ *
+ *  nothing past the delimiter is ever taken from fd, since commands
+ *  run after read may share it:
+ *
+ *  a regular file is read in blocks of BLOCK bytes, kept per fd. After
+ *  a call the offset is put back to just after the delimiter, and the
+ *  next call only uses the block if fd is the same file and the offset
+ *  is still there, so a loop over a file costs a read per block and
+ *  an fstat and an lseek or two a line.
+ *
+ *  a pipe is looked at with tee(2) into a private pipe, which copies
+ *  the bytes waiting in it without taking them, and then exactly the
+ *  bytes up to the delimiter are read. A socket is looked at with
+ *  MSG_PEEK. Either way a line costs three calls, not one per byte.
+ *  Anything else, a terminal, is read a byte at a time.
+ *
+ *  when smsh reads its own commands from stdin through stdio, fd 0 is
+ *  read with getc so the two share the one buffer.
+ */
+
+#define	_GNU_SOURCE
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/socket.h>
+#include	<sys/stat.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"reader.h"
+#include	"fdread.h"
+
+#define	BLOCK	65536
+#define	NOPEEK	(-2)			/* fd can not be peeked at */
+
+struct fdbuf {
+		char	*buf;		/* NULL until first used	*/
+		size_t	start, end;	/* the unread part		*/
+		off_t	pos;		/* file offset of buf[start]	*/
+		dev_t	dev;		/* the file it came from	*/
+		ino_t	ino;
+	};
+
+static struct fdbuf *bufs = NULL;	/* indexed by fd		*/
+static int	nbufs = 0;
+static int	peekpipe[2] = { -1, -1 };
+static char	*peekbuf = NULL;
+
+static void put_bytes(FLEXSTR *out, char *p, size_t n)
+/*
+ * append n bytes to out, growing it by doubling
+ */
+{
+	size_t	need = out->fs_used + n + 1;
+
+	if ( need > (size_t) out->fs_space ) {
+		while ( (size_t) out->fs_space < need )
+			out->fs_space = out->fs_space ? 2 * out->fs_space : 128;
+		out->fs_str = erealloc(out->fs_str, out->fs_space);
+	}
+	memcpy(out->fs_str + out->fs_used, p, n);
+	out->fs_used += n;
+}
+
+static size_t take(char *p, size_t n, int delim, long *leftp, FLEXSTR *out,
+								int *donep)
+/*
+ * purpose: append the bytes at p up to delim, or *leftp of them, to out
+ * returns: how many bytes that used up, the delim included; *donep is
+ *          set if the delim or the count was reached
+ */
+{
+	char	*d = memchr(p, delim, n);
+	size_t	k = ( d ? d - p : n ), used = k;
+
+	if ( *leftp >= 0 && (size_t) *leftp <= k ) {
+		used = k = *leftp;
+		*donep = 1;
+	}
+	else if ( d != NULL ) {
+		used = k + 1;
+		*donep = 1;
+	}
+	put_bytes(out, p, k);
+	if ( *leftp >= 0 )
+		*leftp -= k;
+	return used;
+}
+
+static int from_file(int fd, off_t cur, int delim, long left, FLEXSTR *out)
+{
+	struct fdbuf *bp;
+	struct stat info;
+	off_t	kpos = cur;			/* where fd is now	*/
+	ssize_t	nr = 0;
+	size_t	used;
+	int	done = 0, tag;
+
+	if ( fd >= nbufs ) {
+		tag = mem_tag(MT_READER);
+		bufs = erealloc(bufs, (fd + 1) * sizeof(struct fdbuf));
+		mem_tag(tag);
+		memset(bufs + nbufs, 0, (fd + 1 - nbufs) * sizeof(struct fdbuf));
+		nbufs = fd + 1;
+	}
+	bp = &bufs[fd];
+	if ( bp->buf == NULL ) {
+		tag = mem_tag(MT_READER);
+		bp->buf = emalloc(BLOCK);
+		mem_tag(tag);
+	}
+	if ( fstat(fd, &info) == -1 )
+		return -1;
+	if ( bp->pos != cur || bp->dev != info.st_dev || bp->ino != info.st_ino )
+		bp->start = bp->end = 0;	/* moved: block is stale */
+	bp->pos = cur;
+	bp->dev = info.st_dev;
+	bp->ino = info.st_ino;
+	while ( !done ) {
+		if ( bp->start == bp->end ) {
+			if ( kpos != bp->pos && lseek(fd, bp->pos, SEEK_SET) == -1 )
+				return -1;
+			if ( (nr = read(fd, bp->buf, BLOCK)) <= 0 ) {
+				kpos = bp->pos;
+				break;
+			}
+			kpos = bp->pos + nr;
+			bp->start = 0;
+			bp->end = nr;
+		}
+		used = take(bp->buf + bp->start, bp->end - bp->start, delim,
+							&left, out, &done);
+		bp->start += used;
+		bp->pos += used;
+	}
+	if ( kpos != bp->pos )			/* give back the rest	*/
+		lseek(fd, bp->pos, SEEK_SET);
+	return ( done ? 1 : nr == -1 ? -1 : 0 );
+}
+
+static ssize_t peek(int fd)
+/*
+ * purpose: copy what is waiting on fd into peekbuf, taking none of it
+ * returns: the number of bytes, 0 at EOF, -1 on error, NOPEEK if fd is
+ *          neither a pipe nor a socket
+ */
+{
+	ssize_t	n, got, nr;
+	int	tag;
+
+	if ( peekbuf == NULL ) {
+		if ( pipe2(peekpipe, O_CLOEXEC) == -1 )
+			return NOPEEK;
+		tag = mem_tag(MT_READER);
+		peekbuf = emalloc(BLOCK);
+		mem_tag(tag);
+	}
+	if ( (n = tee(fd, peekpipe[1], BLOCK, 0)) == -1 && errno == EINVAL ) {
+		n = recv(fd, peekbuf, BLOCK, MSG_PEEK);
+		return ( n == -1 && errno == ENOTSOCK ? NOPEEK : n );
+	}
+	for ( got = 0 ; got < n ; got += nr )
+		if ( (nr = read(peekpipe[0], peekbuf + got, n - got)) <= 0 )
+			return -1;
+	return n;
+}
+
+static int from_pipe(int fd, int delim, long left, FLEXSTR *out)
+{
+	ssize_t	n, nr;
+	size_t	used, got;
+	int	done = 0;
+
+	while ( !done ) {
+		if ( (n = peek(fd)) <= 0 )
+			return n;
+		used = take(peekbuf, n, delim, &left, out, &done);
+		for ( got = 0 ; got < used ; got += nr )	/* now take them */
+			if ( (nr = read(fd, peekbuf, used - got)) <= 0 )
+				return -1;
+	}
+	return 1;
+}
+
+static int bytewise(int fd, int delim, long left, FLEXSTR *out)
+{
+	ssize_t	nr;
+	char	c;
+	int	done = 0;
+
+	while ( !done ) {
+		if ( fd == 0 && rd_stdin_shared() ) {
+			if ( (nr = getc(stdin)) == EOF )
+				return ( ferror(stdin) ? -1 : 0 );
+			c = nr;
+		}
+		else if ( (nr = read(fd, &c, 1)) <= 0 )
+			return nr;
+		take(&c, 1, delim, &left, out, &done);
+	}
+	return 1;
+}
+
+int fdr_read(int fd, int delim, long max, FLEXSTR *out)
+/*
+ * purpose: read up to the next delim, which is not kept, or max chars;
+ *          out grows under the caller's memory tag
+ * returns: 1 if the delim or max was reached, 0 at end of file, -1 for
+ *          an error. What was read before the end is in out anyway.
+ */
+{
+	off_t	cur;
+	int	rv;
+
+	if ( max == 0 )
+		return 1;
+	if ( fd == 0 && rd_stdin_shared() )
+		return bytewise(fd, delim, max, out);
+	if ( (cur = lseek(fd, 0, SEEK_CUR)) != -1 )
+		return from_file(fd, cur, delim, max, out);
+	if ( (rv = from_pipe(fd, delim, max, out)) == NOPEEK )
+		rv = bytewise(fd, delim, max, out);
+	return rv;
+}
@@ -0,0 +1,10 @@
+#ifndef	FDREAD_H
+#define	FDREAD_H
+/*
+ * header for fdread.c - input for the read builtin
+ */
+#include	"flexstr.h"
+
+int	fdr_read(int, int, long, FLEXSTR *);
+
+#endif
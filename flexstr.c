@@ -1,5 +1,6 @@
 #include	<stdlib.h>
 #include	<stdio.h>
+#include	<string.h>
 #include	"flexstr.h"
 
 #include	"splitline.h"
@@ -20,6 +21,7 @@
  *	fs_init(FLEXSTR *p,int chunk)
  *	fs_addch(FLEXSTR *p, char c)
  *	fs_addstr(FLEXSTR *p, char *str)
+ *	fs_addmem(FLEXSTR *p, char *s, int n)
  *	char *fs_getstr(FLEXSTR *p)
  *	fs_free(FLEXSTR *p)
  */
@@ -46,9 +48,9 @@ fl_free(FLEXLIST *p)
 	int	i;
 
 	for(i=0; i < p->fl_nused; i++)
-		free(p->fl_list[i]);
+		efree(p->fl_list[i]);
 	if ( p->fl_list )
-		free(p->fl_list);
+		efree(p->fl_list);
 	fl_init(p,p->fl_growby);
 }
 char **
@@ -99,7 +101,7 @@ void
 fs_free(FLEXSTR *p)
 {
 
-	free(p->fs_str);
+	efree(p->fs_str);
 }
 
 char *
@@ -153,3 +155,22 @@ fs_addstr(FLEXSTR *p, char *s)
 		fs_addch(p, c);
 	return 0;
 }
+
+/*
+ * append n chars from s to flexstring, growing it at most once
+ * return 0 for ok dies on error
+ */
+
+int
+fs_addmem(FLEXSTR *p, char *s, int n)
+{
+	if ( p->fs_used + n > p->fs_space ){
+		p->fs_space += p->fs_growby;
+		if ( p->fs_space < p->fs_used + n )
+			p->fs_space = p->fs_used + n;
+		p->fs_str = erealloc(p->fs_str, p->fs_space);
+	}
+	memcpy(p->fs_str + p->fs_used, s, n);
+	p->fs_used += n;
+	return 0;
+}
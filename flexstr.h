@@ -55,6 +55,7 @@ void fs_free(FLEXSTR *p);
 char * fs_getstr(FLEXSTR *p);
 int fs_addch(FLEXSTR *p, char c);
 int fs_addstr(FLEXSTR *p, char *s);
+int fs_addmem(FLEXSTR *p, char *s, int n);
 FLEXSTR *fso_new(int amt);
 
 #endif
@@ -0,0 +1,391 @@
+/* function.c
+ *
+ * shell functions:   name() {
+ *                        commands
+ *                    }
+ *
+ * interface:
+ *     is_function_def( args )       is this line a function header?
+ *     fn_define( args, rd, &line )  read the body from rd and store it
+ *     fn_lookup( name )             returns the function or NULL
+ *     fn_call( f, args )            run f in this process with args
+ *     fn_return( status )           used by the return builtin
+ *     fn_returning()                is a return stopping a function?
+ *
+ * details:
+ *	the body is read once when the definition is seen and kept
+ *	as an array of lines. Lines with nothing to expand (no $, \ or
+ *	wildcard) that are not lists or groups (no ; & | ( or {) are
+ *	split right away, so calling the function runs them with no
+ *	reading, no parsing and no fork. Other lines are expanded
+ *	and split at call time like any other command line.
+ *
+ *	a definition inside a body is built when the outer body is
+ *	stored and registered when that line is reached in a call.
+ *	functions are reference counted since a body can redefine
+ *	the function that is running it.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"varlib.h"
+#include	"builtin.h"
+#include	"controlflow.h"
+#include	"reader.h"
+#include	"function.h"
+
+#define	NBUCKETS	64		/* hash table of functions	*/
+#define	MAXDEPTH	1000		/* nested calls allowed		*/
+
+struct fline {
+		char	*text;		/* raw line, expanded at call	*/
+		char	**words;	/* pre-split, or NULL		*/
+		struct func *def;	/* nested definition here	*/
+		int	skip;		/* lines it used		*/
+	};
+
+struct func {
+		char	*name;
+		struct fline *lines;
+		int	nlines;
+		int	refs;		/* table + running calls	*/
+		struct func *next;	/* hash chain			*/
+	};
+
+static struct func *table[NBUCKETS];
+static int	call_depth = 0;
+static int	returning = 0;		/* set by return builtin	*/
+static int	return_status = 0;
+
+static struct func *build_func(char *, char **, int);
+static void	fn_unref(struct func *);
+static void	fn_register(struct func *);
+static int	find_close(char **, int, int);
+static void	keep_words(char **);
+static char	*def_name(char **);
+
+static unsigned hash(char *s)
+{
+	unsigned h = 0;
+
+	while ( *s )
+		h = h * 31 + (unsigned char) *s++;
+	return h % NBUCKETS;
+}
+
+int is_function_def(char **args)
+/*
+ * purpose: check for a function header: name() {  or  name () {
+ * returns: 1 for yes, 0 for no
+ */
+{
+	char	*name = def_name(args);
+
+	efree(name);
+	return name != NULL;
+}
+
+static char *def_name(char **args)
+/*
+ * returns a copy of the name in a function header, NULL if
+ * args is not a header
+ */
+{
+	char	*name;
+	int	len;
+
+	if ( args[0] == NULL || args[1] == NULL )
+		return NULL;
+	len = strlen(args[0]);
+	if ( strcmp(args[1], "{") == 0 && args[2] == NULL
+			&& len > 2 && strcmp(args[0] + len - 2, "()") == 0 )
+		len -= 2;				/* name() {	*/
+	else if ( strcmp(args[1], "()") == 0 && args[2] != NULL
+			&& strcmp(args[2], "{") == 0 && args[3] == NULL )
+		;					/* name () {	*/
+	else
+		return NULL;
+
+	name = emalloc(len + 1);
+	strncpy(name, args[0], len);
+	name[len] = '\0';
+	if ( !okname(name) ) {
+		efree(name);
+		return NULL;
+	}
+	return name;
+}
+
+static int line_depth(char *text)
+/*
+ * returns +1 if the line opens a function body, -1 if it
+ * closes one, 0 otherwise
+ */
+{
+	char	**words = splitline(text);
+	int	rv = 0;
+
+	if ( words == NULL )
+		return 0;
+	if ( words[0] != NULL && strcmp(words[0], "}") == 0 )
+		rv = -1;
+	else if ( is_function_def(words) )
+		rv = 1;
+	freelist(words);
+	return rv;
+}
+
+int fn_define(char **args, struct reader *rd, int *linenop)
+/*
+ * purpose: read the body of a function from rd and store it
+ * returns: 0 for ok, 1 for a syntax error
+ *    note: the body is consumed even if we are in a branch that is
+ *          not taken, it is just not registered then
+ */
+{
+	int	tag = mem_tag(MT_FUNC);
+	char	*name = def_name(args);
+	char	*view, *line, **raw = NULL;
+	size_t	len;
+	int	n = 0, max = 0, depth = 1;
+
+	while ( (view = rd_next(rd, "", &len)) != NULL ) {
+		line = emalloc(len + 1);		/* keep a copy	*/
+		memcpy(line, view, len);
+		line[len] = '\0';
+		(*linenop)++;
+		depth += line_depth(line);
+		if ( depth == 0 ) {
+			efree(line);
+			break;
+		}
+		if ( n == max ) {
+			max = max ? 2 * max : 16;
+			raw = erealloc(raw, max * sizeof(char *));
+		}
+		raw[n++] = line;
+	}
+	if ( depth != 0 ) {
+		fprintf(stderr, "%s: missing } for function\n", name);
+		while ( n > 0 )
+			efree(raw[--n]);
+		efree(raw);
+		efree(name);
+		mem_tag(tag);
+		return 1;
+	}
+	if ( ok_to_execute() )
+		fn_register(build_func(name, raw, n));
+	else {
+		fn_unref(build_func(name, raw, n));
+	}
+	efree(raw);
+	mem_tag(tag);
+	return 0;
+}
+
+static struct func *build_func(char *name, char **raw, int n)
+/*
+ * purpose: turn n raw body lines into a function
+ *    note: takes over name and the raw strings
+ */
+{
+	struct func *f = emalloc(sizeof(struct func));
+	struct fline *lp;
+	char	**words;
+	int	i, close;
+
+	f->name   = name;
+	f->lines  = emalloc((n > 0 ? n : 1) * sizeof(struct fline));
+	f->nlines = 0;
+	f->refs   = 1;
+	f->next   = NULL;
+
+	for ( i = 0 ; i < n ; i++ ) {
+		words = splitline(raw[i]);
+		if ( words == NULL || words[0] == NULL ) {	/* blank	*/
+			if ( words )
+				freelist(words);
+			efree(raw[i]);
+			continue;
+		}
+		lp = &f->lines[f->nlines++];
+		lp->text = raw[i];
+		lp->def  = NULL;
+		lp->skip = 0;
+		if ( is_function_def(words) ) {
+			close = find_close(raw, i + 1, n);
+			lp->def  = build_func(def_name(words), raw + i + 1,
+						close - i - 1);
+			efree(raw[close]);
+			i = close;
+			freelist(words);
+			words = NULL;
+		}
+		else if ( strpbrk(raw[i], "$\\*?[;&|({") != NULL ) {	/* later */
+			freelist(words);
+			words = NULL;
+		}
+		else
+			keep_words(words);
+		lp->words = words;
+	}
+	return f;
+}
+
+static void keep_words(char **words)
+/*
+ * the words of a split line become part of the body
+ */
+{
+	char	**wp;
+
+	for ( wp = words ; *wp != NULL ; wp++ )
+		mem_retag(*wp, MT_FUNC);
+	mem_retag(words, MT_FUNC);
+}
+
+static int find_close(char **raw, int from, int n)
+/*
+ * returns the index of the } matching a header just before from
+ */
+{
+	int	depth = 1;
+
+	for ( ; from < n ; from++ )
+		if ( (depth += line_depth(raw[from])) == 0 )
+			break;
+	return from;
+}
+
+static void fn_register(struct func *f)
+/*
+ * add f to the table, replacing an older definition
+ */
+{
+	struct func **pp = &table[hash(f->name)];
+
+	for ( ; *pp != NULL ; pp = &(*pp)->next )
+		if ( strcmp((*pp)->name, f->name) == 0 ) {
+			f->next = (*pp)->next;
+			fn_unref(*pp);
+			*pp = f;
+			return;
+		}
+	*pp = f;
+}
+
+static void fn_unref(struct func *f)
+/*
+ * drop a reference to f, freeing it when nobody uses it
+ */
+{
+	int	i;
+
+	if ( --f->refs > 0 )
+		return;
+	for ( i = 0 ; i < f->nlines ; i++ ) {
+		efree(f->lines[i].text);
+		if ( f->lines[i].words )
+			freelist(f->lines[i].words);
+		if ( f->lines[i].def )
+			fn_unref(f->lines[i].def);
+	}
+	efree(f->lines);
+	efree(f->name);
+	efree(f);
+}
+
+struct func *fn_lookup(char *name)
+{
+	struct func *f;
+
+	for ( f = table[hash(name)] ; f != NULL ; f = f->next )
+		if ( strcmp(f->name, name) == 0 )
+			return f;
+	return NULL;
+}
+
+int fn_call(struct func *f, char **args)
+/*
+ * purpose: run a function in this process
+ * returns: status of the last command or the value given to return
+ *  action: give the call its own $1.. and a new variable scope,
+ *          then run each stored line
+ */
+{
+	struct cf_context cf;
+	struct fline *lp;
+	char	**argv, **saved_v;
+	int	argc, saved_c, i, rv = 0;
+
+	if ( call_depth >= MAXDEPTH ) {
+		fprintf(stderr, "%s: maximum function nesting level exceeded\n",
+				f->name);
+		return 1;
+	}
+	for ( argc = 0 ; args[argc] != NULL ; argc++ )
+		;
+	VLgetargs(&saved_c, &saved_v);
+	i = mem_tag(MT_FUNC);
+	argv = emalloc((argc + 1) * sizeof(char *));
+	mem_tag(i);
+	argv[0] = ( saved_c > 0 ? saved_v[0] : f->name );	/* keep $0 */
+	memcpy(argv + 1, args + 1, argc * sizeof(char *));
+	VLsetargs(argc, argv);
+	VLpushscope();
+	cf_save(&cf);
+	f->refs++;
+	call_depth++;
+
+	for ( i = 0 ; i < f->nlines && !returning ; i++ ) {
+		lp = &f->lines[i];
+		if ( lp->def != NULL ) {
+			if ( ok_to_execute() ) {
+				lp->def->refs++;
+				fn_register(lp->def);
+			}
+			continue;
+		}
+		rv = execute_line(lp->text, lp->words);
+		VLsetstatus(rv);
+	}
+	if ( returning ) {
+		rv = return_status;
+		returning = 0;
+	}
+
+	call_depth--;
+	fn_unref(f);
+	cf_restore(&cf);
+	VLpopscope();
+	VLsetargs(saved_c, saved_v);
+	efree(argv);
+	return rv;
+}
+
+int fn_return(int status)
+/*
+ * purpose: make the running function stop with status
+ * returns: status, or -1 if no function is running
+ */
+{
+	if ( call_depth == 0 )
+		return -1;
+	returning = 1;
+	return_status = status;
+	return status;
+}
+
+int fn_returning(void)
+/*
+ * purpose: tell a list that a command of it was return
+ * returns: 1 if the running function is stopping, 0 if not
+ */
+{
+	return returning;
+}
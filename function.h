@@ -0,0 +1,16 @@
+#ifndef	FUNCTION_H
+#define	FUNCTION_H
+/*
+ * header for function.c - shell functions
+ */
+struct func;
+struct reader;
+
+int	is_function_def(char **);
+int	fn_define(char **, struct reader *, int *);
+struct func *fn_lookup(char *);
+int	fn_call(struct func *, char **);
+int	fn_return(int);
+int	fn_returning(void);
+
+#endif
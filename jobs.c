@@ -0,0 +1,327 @@
+/* jobs.c - background jobs for smsh
+ *
+ *    jobs_init()                  catch SIGCHLD, at startup
+ *    job_add( pid )               a command was started with &
+ *    job_find( spec )             job for %n or a pid, NULL if none
+ *    job_wait( job )              wait for it, returns its status
+ *    job_wait_any( jobs, n, &pid ) wait for the first of them to end
+ *    job_wait_all()               wait for every job
+ *    jobs_reap()                  collect jobs that have ended
+ *    jobs_running()               are any jobs not yet reaped?
+ *
+ *  each job gets a pidfd when it is started. Waiting for one job is a
+ *  waitid on its pidfd, and waiting for whichever ends first is one
+ *  poll() on all their pidfds, so the shell sleeps in the kernel and
+ *  never loops. Kernels without pidfd_open fall back to waitid on the
+ *  pid, and for wait -n to trying each job's pid with WNOHANG each
+ *  time a SIGCHLD comes in, so no child that is not a job is reaped.
+ *
+ *  a job that ends while the shell is busy stays a zombie until the
+ *  SIGCHLD handler's flag makes jobs_reap collect it after the current
+ *  command line. Its status is kept until a wait reports it, for the
+ *  last MAXDONE such jobs; older ones are dropped when a job is added.
+ */
+
+#define	_GNU_SOURCE
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<poll.h>
+#include	<signal.h>
+#include	<unistd.h>
+#include	<sys/syscall.h>
+#include	<sys/wait.h>
+
+#include	"smsh.h"
+#include	"varlib.h"
+#include	"memstat.h"
+#include	"jobs.h"
+
+#ifndef	P_PIDFD
+#define	P_PIDFD	3
+#endif
+
+struct job {
+		int	id;		/* the n of %n			*/
+		pid_t	pid;
+		int	pidfd;		/* -1 if the kernel has none	*/
+		int	done;		/* reaped, status is good	*/
+		int	status;		/* as $? would have it		*/
+	};
+
+#define	MAXDONE	64			/* ended jobs kept for wait */
+
+static struct job **jobs = NULL;
+static int	njobs = 0, maxjobs = 0;
+static volatile sig_atomic_t child_ended = 0;
+
+static void on_sigchld(int sig)
+{
+	child_ended = 1;
+}
+
+void jobs_init()
+/*
+ * the handler only sets a flag; SA_RESTART keeps reads going
+ */
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_sigchld;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+}
+
+static int	forget(struct job *);
+
+static void prune()
+/*
+ * drop the oldest ended jobs nobody waited for, keeping MAXDONE. The
+ * newest job, $!, is never dropped, so the job numbers go on from it.
+ */
+{
+	int	i, ndone = 0;
+
+	for ( i = 0 ; i < njobs ; i++ )
+		ndone += jobs[i]->done;
+	for ( i = 0 ; ndone > MAXDONE && i < njobs - 1 ; )
+		if ( jobs[i]->done ) {
+			forget(jobs[i]);
+			ndone--;
+		}
+		else
+			i++;
+}
+
+int job_add(pid_t pid)
+/*
+ * purpose: record a child started in the background
+ * returns: the job number
+ */
+{
+	struct job *jp;
+	int	tag;
+
+	prune();
+	tag = mem_tag(MT_JOBS);
+
+	if ( njobs == maxjobs ) {
+		maxjobs = maxjobs ? 2 * maxjobs : 8;
+		jobs = erealloc(jobs, maxjobs * sizeof(struct job *));
+	}
+	jp = emalloc(sizeof(struct job));
+	jp->id     = ( njobs > 0 ? jobs[njobs-1]->id + 1 : 1 );
+	jp->pid    = pid;
+	jp->pidfd  = syscall(SYS_pidfd_open, pid, 0);
+	jp->done   = 0;
+	jp->status = 0;
+	jobs[njobs++] = jp;
+	mem_tag(tag);
+	VLsetbgpid(pid);
+	return jp->id;
+}
+
+struct job *job_find(char *spec)
+/*
+ * spec is %n for job n or a process id
+ */
+{
+	char	*end;
+	long	n;
+	int	i;
+
+	n = strtol(spec + (*spec == '%'), &end, 10);
+	if ( *end != '\0' || end == spec + (*spec == '%') )
+		return NULL;
+	for ( i = 0 ; i < njobs ; i++ )
+		if ( (*spec == '%' ? jobs[i]->id : jobs[i]->pid) == n )
+			return jobs[i];
+	return NULL;
+}
+
+static void set_status(struct job *jp, siginfo_t *sip)
+{
+	jp->done = 1;
+	if ( sip->si_code == CLD_EXITED )
+		jp->status = sip->si_status;
+	else
+		jp->status = 128 + sip->si_status;	/* killed	*/
+	if ( jp->pidfd != -1 ) {
+		close(jp->pidfd);
+		jp->pidfd = -1;
+	}
+}
+
+static int forget(struct job *jp)
+/*
+ * drop a job that has been reported, returns its status
+ */
+{
+	int	i, status = jp->status;
+
+	for ( i = 0 ; jobs[i] != jp ; i++ )
+		;
+	memmove(jobs + i, jobs + i + 1, (njobs - i - 1) * sizeof(struct job *));
+	njobs--;
+	efree(jp);
+	return status;
+}
+
+static int reap(struct job *jp, int flags)
+/*
+ * waitid for one job. returns 1 if it has ended
+ */
+{
+	siginfo_t si;
+	int	rv;
+
+	if ( jp->done )
+		return 1;
+	memset(&si, 0, sizeof(si));
+	do {
+		if ( jp->pidfd != -1 ) {
+			rv = waitid(P_PIDFD, jp->pidfd, &si, WEXITED | flags);
+			if ( rv == -1 && errno == EINVAL ) {	/* old kernel */
+				close(jp->pidfd);
+				jp->pidfd = -1;
+			}
+		}
+		if ( jp->pidfd == -1 )
+			rv = waitid(P_PID, jp->pid, &si, WEXITED | flags);
+	} while ( rv == -1 && errno == EINTR );
+	if ( rv == -1 ) {			/* not ours any more	*/
+		jp->done = 1;
+		jp->status = 127;
+		if ( jp->pidfd != -1 ) {
+			close(jp->pidfd);
+			jp->pidfd = -1;
+		}
+		return 1;
+	}
+	if ( si.si_pid == 0 )			/* WNOHANG, still up	*/
+		return 0;
+	set_status(jp, &si);
+	return 1;
+}
+
+int job_wait(struct job *jp)
+/*
+ * purpose: wait for a job to end
+ * returns: its status
+ */
+{
+	reap(jp, 0);
+	return forget(jp);
+}
+
+static struct job *wait_pids(struct job **list, int n)
+/*
+ * wait -n with no pidfds: try each job with WNOHANG and sleep until
+ * a SIGCHLD if none has ended. SIGCHLD is held off from the tries to
+ * sigsuspend, so one that comes in between them is not missed.
+ */
+{
+	sigset_t chld, old, wake;
+	struct job *jp = NULL;
+	int	i;
+
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &old);
+	wake = old;
+	sigdelset(&wake, SIGCHLD);
+	while ( jp == NULL ) {
+		for ( i = 0 ; i < n && jp == NULL ; i++ )
+			if ( reap(list[i], WNOHANG) )
+				jp = list[i];
+		if ( jp == NULL )
+			sigsuspend(&wake);
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return jp;
+}
+
+int job_wait_any(struct job **list, int n, pid_t *pidp)
+/*
+ * purpose: wait for the first of n jobs to end, any job if n is 0
+ * returns: its status and its pid in *pidp, -1 if there is no job
+ *  method: a job already reaped wins. Otherwise poll the pidfds,
+ *          which become readable when the process ends.
+ */
+{
+	struct pollfd *fds;
+	struct job *jp = NULL;
+	int	i, nfds, all = ( n == 0 );
+
+	if ( all ) {
+		list = jobs;
+		n = njobs;
+	}
+	if ( n == 0 )
+		return -1;
+	for ( i = 0 ; i < n && jp == NULL ; i++ )
+		if ( list[i]->done )
+			jp = list[i];
+
+	i = mem_tag(MT_JOBS);
+	fds = emalloc(n * sizeof(struct pollfd));
+	mem_tag(i);
+	while ( jp == NULL ) {
+		for ( i = nfds = 0 ; i < n ; i++ )
+			if ( list[i]->pidfd != -1 ) {
+				fds[nfds].fd = list[i]->pidfd;
+				fds[nfds++].events = POLLIN;
+			}
+		if ( nfds < n ) {		/* no pidfds: each pid	*/
+			jp = wait_pids(list, n);
+			break;
+		}
+		if ( poll(fds, nfds, -1) == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			break;
+		}
+		for ( i = 0 ; i < n && jp == NULL ; i++ )
+			if ( list[i]->pidfd != -1 && reap(list[i], WNOHANG) )
+				jp = list[i];
+	}
+	efree(fds);
+	if ( jp == NULL )
+		return -1;
+	*pidp = jp->pid;
+	return forget(jp);
+}
+
+void job_wait_all()
+{
+	while ( njobs > 0 )
+		job_wait(jobs[0]);
+}
+
+void jobs_reap()
+/*
+ * collect the jobs that have ended since the last call. Cheap when
+ * no SIGCHLD came in.
+ */
+{
+	int	i;
+
+	if ( !child_ended )
+		return;
+	child_ended = 0;
+	for ( i = 0 ; i < njobs ; i++ )
+		reap(jobs[i], WNOHANG);
+}
+
+int jobs_running()
+{
+	int	i;
+
+	for ( i = 0 ; i < njobs ; i++ )
+		if ( !jobs[i]->done )
+			return 1;
+	return 0;
+}
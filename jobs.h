@@ -0,0 +1,19 @@
+#ifndef	JOBS_H
+#define	JOBS_H
+/*
+ * header for jobs.c - background jobs
+ */
+#include	<sys/types.h>
+
+struct job;
+
+void	jobs_init();
+int	job_add(pid_t);
+struct job *job_find(char *);
+int	job_wait(struct job *);
+int	job_wait_any(struct job **, int, pid_t *);
+void	job_wait_all();
+void	jobs_reap();
+int	jobs_running();
+
+#endif
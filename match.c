@@ -0,0 +1,125 @@
+/* match.c - shell pattern matching, as in fnmatch(3) with no flags
+ *
+ *    pmatch(pattern, str)    1 if str matches pattern, 0 if not
+ *    has_wildcards(str)      1 if str has an unescaped * ? or [...]
+ *
+ *  patterns:   *       any string, including the empty one
+ *              ?       any one char
+ *              [...]   one char from the set, a-z ranges allowed,
+ *                      [!...] or [^...] for the complement
+ *              \c      the char c itself
+ *  a [ with no closing ] is an ordinary char.
+ */
+
+#include	<string.h>
+#include	"match.h"
+
+static char *class_end(char *p)
+/*
+ * p points just past a [. returns pointer to the closing ], or
+ * NULL if there is none
+ */
+{
+	if ( *p == '!' || *p == '^' )
+		p++;
+	if ( *p == ']' )			/* []...] has ] in the set */
+		p++;
+	for ( ; *p != '\0' ; p++ ) {
+		if ( *p == ']' )
+			return p;
+		if ( *p == '\\' && p[1] != '\0' )
+			p++;
+	}
+	return NULL;
+}
+
+static int in_class(char *p, char *end, int c)
+/*
+ * is c in the set p[0]..end[-1]? (the part between [ and ])
+ */
+{
+	int	negate = 0, found = 0, lo, hi;
+
+	if ( *p == '!' || *p == '^' ) {
+		negate = 1;
+		p++;
+	}
+	while ( p < end ) {
+		if ( *p == '\\' && p + 1 < end )
+			p++;
+		lo = (unsigned char) *p++;
+		hi = lo;
+		if ( *p == '-' && p + 1 < end ) {	/* a range	*/
+			p++;
+			if ( *p == '\\' && p + 1 < end )
+				p++;
+			hi = (unsigned char) *p++;
+		}
+		if ( lo <= c && c <= hi )
+			found = 1;
+	}
+	return found != negate;
+}
+
+int pmatch(char *p, char *s)
+/*
+ * purpose: match s against pattern p
+ *  method: the usual: walk both, and on a mismatch go back to the
+ *          last * and let it eat one more char of s
+ */
+{
+	char	*star_p = NULL, *star_s = NULL, *end, *next;
+	int	ok;
+
+	while ( *s != '\0' ) {
+		if ( *p == '*' ) {
+			while ( *p == '*' )
+				p++;
+			if ( *p == '\0' )
+				return 1;
+			star_p = p;
+			star_s = s;
+			continue;
+		}
+		if ( *p == '?' ) {
+			ok = 1;
+			next = p + 1;
+		}
+		else if ( *p == '[' && (end = class_end(p + 1)) != NULL ) {
+			ok = in_class(p + 1, end, (unsigned char) *s);
+			next = end + 1;
+		}
+		else {
+			if ( *p == '\\' && p[1] != '\0' )
+				p++;
+			ok = ( *p == *s );
+			next = p + 1;
+		}
+		if ( ok ) {
+			p = next;
+			s++;
+		}
+		else if ( star_p != NULL ) {
+			p = star_p;
+			s = ++star_s;
+		}
+		else
+			return 0;
+	}
+	while ( *p == '*' )
+		p++;
+	return *p == '\0';
+}
+
+int has_wildcards(char *s)
+{
+	for ( ; *s != '\0' ; s++ ) {
+		if ( *s == '\\' && s[1] != '\0' )
+			s++;
+		else if ( *s == '*' || *s == '?' )
+			return 1;
+		else if ( *s == '[' && class_end(s + 1) != NULL )
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef	MATCH_H
+#define	MATCH_H
+/*
+ * header for match.c - shell pattern matching
+ */
+
+int	pmatch(char *, char *);
+int	has_wildcards(char *);
+
+#endif
@@ -0,0 +1,164 @@
+/* memstat.c - accounted allocation for smsh
+ *
+ *    emalloc(n) / erealloc(p, n)  malloc/realloc, fatal on failure
+ *    efree(p)                     free a block from emalloc
+ *    mem_tag(tag)                 charge new blocks to tag, returns old
+ *    mem_retag(p, tag)            hand a block over to another owner
+ *    mem_endline()                called when a command line is done
+ *    mem_report()                 the memstats builtin
+ *
+ *  every block carries a small header with its size and the subsystem
+ *  that allocated it, so the counts stay right when the block is
+ *  freed somewhere else. A subsystem makes itself current with
+ *  mem_tag() on the way in and puts the old tag back on the way out.
+ *
+ *  expansion and tokenizer blocks only live while a command line
+ *  runs. Whatever of theirs is still allocated when the line is done
+ *  is counted as leaked. For the rest live memory is expected, so
+ *  a steady state shows up as live bytes that stop growing.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	"smsh.h"
+#include	"memstat.h"
+
+struct header {
+		size_t	size;		/* bytes asked for	*/
+		size_t	tag;		/* owner		*/
+	};
+
+struct counts {
+		size_t	live, peak;	/* bytes		*/
+		long	allocs, frees;
+		long	leaked;		/* blocks, see above	*/
+	};
+
+static struct counts stats[MT_NTAGS];
+static size_t	total_live = 0, total_peak = 0;
+static int	curtag = MT_OTHER;
+static char	*tagnames[MT_NTAGS] = {
+	"other", "varlib", "expansion", "tokenizer", "reader", "jobs",
+	"functions"
+};
+
+static void charge(struct header *h)
+{
+	struct counts *cp = &stats[h->tag];
+
+	cp->live += h->size;
+	if ( cp->live > cp->peak )
+		cp->peak = cp->live;
+	total_live += h->size;
+	if ( total_live > total_peak )
+		total_peak = total_live;
+}
+
+static void uncharge(struct header *h)
+{
+	stats[h->tag].live -= h->size;
+	total_live -= h->size;
+}
+
+void * emalloc(size_t n)
+{
+	struct header *h;
+
+	if ( (h = malloc(sizeof(struct header) + n)) == NULL )
+		fatal("out of memory","",1);
+	h->size = n;
+	h->tag  = curtag;
+	stats[curtag].allocs++;
+	charge(h);
+	return h + 1;
+}
+
+void * erealloc(void *p, size_t n)
+{
+	struct header *h;
+
+	if ( p == NULL )
+		return emalloc(n);
+	h = (struct header *) p - 1;
+	uncharge(h);
+	if ( (h = realloc(h, sizeof(struct header) + n)) == NULL )
+		fatal("realloc() failed","",1);
+	h->size = n;
+	charge(h);
+	return h + 1;
+}
+
+void efree(void *p)
+{
+	struct header *h;
+
+	if ( p == NULL )
+		return;
+	h = (struct header *) p - 1;
+	uncharge(h);
+	stats[h->tag].frees++;
+	free(h);
+}
+
+int mem_tag(int tag)
+/*
+ * charge blocks allocated from now on to tag
+ * returns the tag that was current, to be put back later
+ */
+{
+	int	old = curtag;
+
+	curtag = tag;
+	return old;
+}
+
+void mem_retag(void *p, int tag)
+/*
+ * move a block to another owner, as when a split line becomes
+ * part of a stored function body. Counts as a free for the old
+ * owner and an allocation for the new one.
+ */
+{
+	struct header *h = (struct header *) p - 1;
+
+	uncharge(h);
+	stats[h->tag].frees++;
+	h->tag = tag;
+	stats[tag].allocs++;
+	charge(h);
+}
+
+void mem_endline()
+/*
+ * a command line is done: note what the per-line owners still hold
+ */
+{
+	stats[MT_EXPAND].leaked = stats[MT_EXPAND].allocs - stats[MT_EXPAND].frees;
+	stats[MT_TOKEN].leaked  = stats[MT_TOKEN].allocs  - stats[MT_TOKEN].frees;
+}
+
+void mem_report()
+/*
+ * print a table of the counts, one line per subsystem
+ */
+{
+	long	allocs = 0, frees = 0, leaked = 0;
+	int	i;
+
+	printf("%-10s %10s %10s %9s %9s %7s\n",
+		"subsystem", "live", "peak", "allocs", "frees", "leaked");
+	for ( i = 0 ; i < MT_NTAGS ; i++ ) {
+		printf("%-10s %10zu %10zu %9ld %9ld ", tagnames[i],
+			stats[i].live, stats[i].peak,
+			stats[i].allocs, stats[i].frees);
+		if ( i == MT_EXPAND || i == MT_TOKEN )
+			printf("%7ld\n", stats[i].leaked);
+		else
+			printf("%7s\n", "-");
+		allocs += stats[i].allocs;
+		frees  += stats[i].frees;
+		leaked += stats[i].leaked;
+	}
+	printf("%-10s %10zu %10zu %9ld %9ld %7ld\n", "total",
+		total_live, total_peak, allocs, frees, leaked);
+}
@@ -0,0 +1,21 @@
+#ifndef	MEMSTAT_H
+#define	MEMSTAT_H
+/*
+ * header for memstat.c - accounted allocation
+ */
+#include	<stddef.h>
+
+enum mem_tags {				/* who owns a block	*/
+	MT_OTHER, MT_VARLIB, MT_EXPAND, MT_TOKEN, MT_READER, MT_JOBS,
+	MT_FUNC, MT_NTAGS
+};
+
+void	*emalloc(size_t);
+void	*erealloc(void *, size_t);
+void	efree(void *);
+int	mem_tag(int);
+void	mem_retag(void *, int);
+void	mem_endline();
+void	mem_report();
+
+#endif
@@ -0,0 +1,67 @@
+/* mkcmdhash.c - writes cmdhash.h for the names in cmdtab.def
+ *
+ *	usage: mkcmdhash > cmdhash.h
+ *
+ *  finds a table size and a seed for cmd_hash() under which no two
+ *  names share a slot, and writes them with the slot table. Run by
+ *  make whenever cmdtab.def changes. The slots are signed chars, so it
+ *  fails if cmdtab.def has more than MAXNAMES names.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	"builtin.h"
+
+static char *names[] = {
+#define	CMD(name, fn, kind)	name,
+#include	"cmdtab.def"
+#undef	CMD
+};
+
+#define	NNAMES	(int)(sizeof(names) / sizeof(names[0]))
+#define	MAXSEEDS	1000000
+#define	MAXNAMES	127		/* the slots are signed chars */
+
+int main()
+{
+	int	size, i, *slot, *sp;
+	unsigned seed;
+
+	if ( NNAMES > MAXNAMES ) {
+		fprintf(stderr, "mkcmdhash: %d names in cmdtab.def, the slot "
+				"table holds at most %d\n", NNAMES, MAXNAMES);
+		return 1;
+	}
+	for ( size = 8 ; size < 2 * NNAMES ; size *= 2 )
+		;
+	for ( ; ; size *= 2 ) {
+		slot = malloc(size * sizeof(int));
+		for ( seed = 1 ; seed < MAXSEEDS ; seed++ ) {
+			for ( i = 0 ; i < size ; i++ )
+				slot[i] = -1;
+			for ( i = 0 ; i < NNAMES ; i++ ) {
+				sp = &slot[cmd_hash(names[i], seed) & (size-1)];
+				if ( *sp != -1 )
+					break;
+				*sp = i;
+			}
+			if ( i == NNAMES )
+				break;
+		}
+		if ( seed < MAXSEEDS )
+			break;
+		free(slot);
+	}
+
+	printf("/* cmdhash.h - made by mkcmdhash from cmdtab.def, do not edit */\n\n");
+	printf("#define\tCMD_SEED\t%uu\n", seed);
+	printf("#define\tCMD_MASK\t%d\n\n", size - 1);
+	printf("static const signed char cmd_slot[%d] = {", size);
+	for ( i = 0 ; i < size ; i++ )
+		printf("%s%3d,", i % 16 ? " " : "\n\t", slot[i]);
+	printf("\n};\n");
+	free(slot);
+	return 0;
+}
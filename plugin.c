@@ -0,0 +1,146 @@
+/* plugin.c - builtins loaded from shared objects
+ *
+ * interface:
+ *     plugin_load( path, name )   dlopen path and add its builtin name
+ *     plugin_unload( name )       drop a loaded builtin
+ *     plugin_lookup( name )       the table entry for name, or NULL
+ *     plugin_list()               print the loaded builtins
+ *
+ * details:
+ *	a loaded builtin gets a struct builtin like the ones built from
+ *	cmdtab.def, so once cmd_lookup finds it, it is run the same way.
+ *	Those are in a small chained hash table here since they are not
+ *	known when the perfect hash is made. cmd_lookup only asks here
+ *	when a name is not in cmdtab.def, and with nothing loaded that
+ *	costs one test.
+ *
+ *	each name holds its own dlopen reference, so dropping one name
+ *	leaves the others from the same library working.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<dlfcn.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"builtin.h"
+#include	"plugin.h"
+
+#define	NBUCKETS	32
+
+struct plugin {
+		struct builtin b;	/* what cmd_lookup returns	*/
+		char	*path;
+		void	*handle;	/* from dlopen			*/
+		struct plugin *next;	/* hash chain			*/
+	};
+
+static struct plugin *table[NBUCKETS];
+static int	nplugins = 0;
+
+static struct plugin **find(char *name)
+/*
+ * returns the link that points at the plugin for name, or at the
+ * NULL that ends its chain
+ */
+{
+	struct plugin **pp = &table[cmd_hash(name, 0) & (NBUCKETS-1)];
+
+	while ( *pp != NULL && strcmp((*pp)->b.name, name) != 0 )
+		pp = &(*pp)->next;
+	return pp;
+}
+
+int plugin_load(char *path, char *name)
+/*
+ * purpose: load the builtin name from the shared object path
+ * returns: 0 for ok, 1 for trouble (reported here)
+ */
+{
+	struct plugin *p, **pp;
+	void	*handle;
+	int	*version;
+	char	*sym;
+	int	(*fn)(char **);
+
+	if ( cmd_lookup(name) != NULL && *find(name) == NULL ) {
+		fprintf(stderr, "enable: %s: is a shell builtin\n", name);
+		return 1;
+	}
+	if ( (handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL ) {
+		fprintf(stderr, "enable: %s\n", dlerror());
+		return 1;
+	}
+	version = dlsym(handle, "smsh_plugin_version");
+	if ( version == NULL || *version != SMSH_PLUGIN_VERSION ) {
+		fprintf(stderr, "enable: %s: not a plugin for this shell\n", path);
+		dlclose(handle);
+		return 1;
+	}
+	sym = emalloc(strlen(name) + sizeof("_builtin"));
+	sprintf(sym, "%s_builtin", name);
+	*(void **) &fn = dlsym(handle, sym);	/* no cast from void *	*/
+	efree(sym);
+	if ( fn == NULL ) {
+		fprintf(stderr, "enable: %s: no builtin %s in it\n", path, name);
+		dlclose(handle);
+		return 1;
+	}
+
+	plugin_unload(name);			/* loading it again	*/
+	p = emalloc(sizeof(struct plugin));
+	p->b.name   = newstr(name, strlen(name));
+	p->b.fn     = fn;
+	p->b.kind   = CMD_BUILTIN;
+	p->path     = newstr(path, strlen(path));
+	p->handle   = handle;
+	pp = find(name);
+	p->next = *pp;
+	*pp = p;
+	nplugins++;
+	return 0;
+}
+
+int plugin_unload(char *name)
+/*
+ * purpose: drop the loaded builtin name
+ * returns: 0 for ok, 1 if name was not loaded
+ */
+{
+	struct plugin *p, **pp = find(name);
+
+	if ( (p = *pp) == NULL )
+		return 1;
+	*pp = p->next;
+	dlclose(p->handle);
+	efree(p->b.name);
+	efree(p->path);
+	efree(p);
+	nplugins--;
+	return 0;
+}
+
+struct builtin *plugin_lookup(char *name)
+{
+	struct plugin *p;
+
+	if ( nplugins == 0 )
+		return NULL;
+	p = *find(name);
+	return ( p ? &p->b : NULL );
+}
+
+void plugin_list()
+/*
+ * enable with no args: one line per loaded builtin
+ */
+{
+	struct plugin *p;
+	int	i;
+
+	for ( i = 0 ; i < NBUCKETS ; i++ )
+		for ( p = table[i] ; p != NULL ; p = p->next )
+			printf("enable -f %s %s\n", p->path, p->b.name);
+}
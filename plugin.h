@@ -0,0 +1,29 @@
+#ifndef	PLUGIN_H
+#define	PLUGIN_H
+/*
+ * header for plugin.c - builtins loaded with  enable -f lib.so name
+ *
+ * a plugin is a shared object that defines, for each builtin name
+ * in it,
+ *
+ *	int name_builtin(char **args)
+ *
+ * which gets the whole arglist, args[0] being the name, and returns
+ * the exit status like any builtin. It must also define
+ *
+ *	int smsh_plugin_version = SMSH_PLUGIN_VERSION;
+ *
+ * so a plugin built against another shell is not loaded. Plugins
+ * may call the VL* functions in varlib.h to get and set variables.
+ */
+
+#define	SMSH_PLUGIN_VERSION	1
+
+struct builtin;
+
+int	plugin_load(char *, char *);
+int	plugin_unload(char *);
+struct builtin *plugin_lookup(char *);
+void	plugin_list();
+
+#endif
@@ -0,0 +1,45 @@
+/* kvget.c - a sample smsh plugin
+ *
+ *	enable -f plugins/kvget.so kvget
+ *	kvget file key [name]
+ *
+ * looks key up in a file of key=value lines and puts the value in
+ * the variable name, REPLY by default. Exit status 1 if the key is
+ * not there, 2 if the file cannot be read. Doing this in the shell
+ * saves the fork and exec of a grep or awk for every lookup.
+ */
+
+#include	<stdio.h>
+#include	<string.h>
+
+#include	"plugin.h"
+#include	"varlib.h"
+
+int smsh_plugin_version = SMSH_PLUGIN_VERSION;
+
+int kvget_builtin(char **args)
+{
+	char	line[BUFSIZ], *name;
+	FILE	*fp;
+	size_t	klen;
+	int	rv = 1;
+
+	if ( args[1] == NULL || args[2] == NULL ) {
+		fprintf(stderr, "usage: kvget file key [name]\n");
+		return 2;
+	}
+	name = ( args[3] ? args[3] : "REPLY" );
+	if ( (fp = fopen(args[1], "r")) == NULL ) {
+		perror(args[1]);
+		return 2;
+	}
+	klen = strlen(args[2]);
+	while ( rv == 1 && fgets(line, sizeof(line), fp) != NULL ) {
+		if ( strncmp(line, args[2], klen) != 0 || line[klen] != '=' )
+			continue;
+		line[strcspn(line, "\n")] = '\0';
+		rv = VLstore(name, line + klen + 1);
+	}
+	fclose(fp);
+	return rv;
+}
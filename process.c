@@ -1,14 +1,23 @@
+#define	_GNU_SOURCE
 #include	<stdio.h>
 #include	<stdlib.h>
 #include	<unistd.h>
 #include	<signal.h>
 #include	<sys/wait.h>
 #include	<string.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<poll.h>
+#include	<time.h>
+#include	<sys/syscall.h>
 #include	"smsh.h"
 #include	"builtin.h"
 #include	"varlib.h"
 #include	"controlflow.h"
 #include	"process.h"
+#include	"function.h"
+#include	"memstat.h"
+#include	"jobs.h"
 
 
 /* process.c
@@ -20,11 +29,100 @@
  * two main classes of processing:
  *	a) process - checks for flow control (if, while, for ...)
  * 	b) do_command - does the command by 
- *		         1. Is command built-in? (exit, set, read, cd, ...)
- *                       2. If not builtin, run the program (fork, exec...)
+ *		         1. Is command a shell function? run it in process
+ *		         2. Is command built-in? (exit, set, read, cd, ...)
+ *		         3. Is it an assignment? (name=val)
+ *                       4. If not builtin, run the program (fork, exec...)
  *                    - also does variable substitution (should be earlier)
+ *
+ * the builtin table is searched once per command, in process, and the
+ * entry found is handed on to do_command.
+ *
+ * a command that ends with a & word is run by run_background in a
+ * child the shell does not wait for; jobs.c keeps track of it.
+ *
+ * execute_timed is execute with a deadline, for the timeout builtin.
+ * start_coproc runs a command in the background with its stdin and
+ * stdout on fds the caller gives it, for the coproc builtin.
+ *
+ * the last command of a script or of a -c string is marked with
+ * proc_last. If it is a program and no job is left running, process
+ * execs it in place of the shell: the script's status is then the
+ * program's, with one fork and one smsh process fewer.
  */
 
+static int last_cmd = 0;		/* the next command ends it all	*/
+
+void proc_last(int on)
+{
+	last_cmd = on;
+}
+
+int proc_is_last()
+{
+	return last_cmd;
+}
+
+static int is_program(char **args, struct builtin *cmd)
+/*
+ * is args a program to exec, not a builtin, function or assignment?
+ */
+{
+	return cmd == NULL && fn_lookup(args[0]) == NULL
+		&& strchr(args[0], '=') == NULL;
+}
+
+static void exec_program(char **args, int async)
+/*
+ * purpose: exec the program named by args, in a child or as the shell's
+ *          last act. An async child keeps ignoring SIGINT and SIGQUIT.
+ * returns: does not
+ */
+{
+	extern char **environ;
+
+	environ = VLtable2environ();
+	if ( !async ) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+	}
+	signal(SIGPIPE, SIG_DFL);		/* the shell ignores it	*/
+	execvp(args[0], args);
+	perror("cannot execute command");
+	_exit(1);
+}
+
+static void run_in_child(char **args, struct builtin *cmd, int async)
+/*
+ * purpose: in a forked child, run args: a program is exec'd, a
+ *          function or builtin is run here and its status is the
+ *          child's exit status
+ * returns: does not
+ */
+{
+	int	rv;
+
+	if ( is_program(args, cmd) )
+		exec_program(args, async);
+	if ( !async ) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+	}
+	rv = do_command(args, cmd);
+	fflush(stdout);
+	_exit(rv);		/* not exit: leave stdin's offset */
+}
+
+static void tail_exec(char **args)
+/*
+ * purpose: run the program named by args as the shell's last act
+ * returns: does not, the shell is gone
+ */
+{
+	fflush(stdout);
+	exec_program(args, 0);
+}
+
 
 int process(char *args[])
 /*
@@ -33,14 +131,24 @@ int process(char *args[])
  *  errors: arise from subroutines, handled there
  */
 {
-	int		rv = 0;
+	int		rv = 0, n, last = last_cmd;
+	struct builtin	*cmd;
 
+	last_cmd = 0;
 	if ( args[0] == NULL ) {
 		rv = 0; 
-	} else if ( is_control_command(args[0]) ) {
-		rv = do_control_command(args); 
+	} else if ( (cmd = cmd_lookup(args[0])) != NULL
+				&& cmd->kind == CMD_KEYWORD ) {
+		rv = cmd->fn(args); 
 	} else if ( ok_to_execute() ) {
-		rv = do_command(args); 
+		for ( n = 1 ; args[n] != NULL ; n++ )
+			;
+		if ( n > 1 && strcmp(args[n-1], "&") == 0 )
+			rv = run_background(args, n - 1, cmd);
+		else if ( last && is_program(args, cmd) && !jobs_running() )
+			tail_exec(args);
+		else
+			rv = do_command(args, cmd); 
 	}
 	return rv;
 }
@@ -50,20 +158,59 @@ int process(char *args[])
  *   purpose: do a command - either builtin or external
  *   returns: result of the command
  *    errors: returned by the builtin command or from exec,fork,wait
- *      note: this version does variable substitution: not where sh does it
+ *      note: cmd is the builtin table entry for args[0], or NULL
  *
  */
-int do_command(char **args)
+int do_command(char **args, struct builtin *cmd)
 {
-	int  is_builtin(char **, int *);
 	int  rv;
+	struct func *f;
 
-	if ( is_builtin(args, &rv) )
+	if ( (f = fn_lookup(args[0])) != NULL )
+		return fn_call(f, args);
+	if ( cmd != NULL )
+		return cmd->fn(args);
+	if ( is_assignment(args, &rv) )
 		return rv;
 	rv = execute(args);
 	return rv >> 8; /* child process return value is high 8 bits */
 }
 
+int run_background(char **args, int argc, struct builtin *cmd)
+/*
+ * purpose: run the first argc words of args without waiting
+ * returns: 0, or 1 if the fork failed
+ *  action: the child reads /dev/null, and runs a program with exec
+ *          right away. A function or builtin is run in the child
+ *          and its status is the child's exit status.
+ */
+{
+	char	**argv;
+	int	pid, fd, tag = mem_tag(MT_JOBS);
+
+	argv = emalloc((argc + 1) * sizeof(char *));	/* args minus & */
+	mem_tag(tag);
+	memcpy(argv, args, argc * sizeof(char *));
+	argv[argc] = NULL;
+
+	fflush(stdout);
+	if ( (pid = fork()) == -1 ) {
+		perror("fork");
+		efree(argv);
+		return 1;
+	}
+	if ( pid == 0 ) {
+		if ( (fd = open("/dev/null", O_RDONLY)) != -1 ) {
+			dup2(fd, 0);
+			close(fd);
+		}
+		run_in_child(argv, cmd, 1);
+	}
+	job_add(pid);
+	efree(argv);
+	return 0;
+}
+
 int execute(char *argv[])
 /*
  * purpose: run a program passing it arguments
@@ -71,7 +218,6 @@ int execute(char *argv[])
  *  errors: -1 on fork() or wait() errors
  */
 {
-	extern char **environ;		/* note: declared in <unistd.h>	*/
 	int	pid ;
 	int	child_info = -1;
 
@@ -79,20 +225,153 @@ int execute(char *argv[])
 		return 0;
 	}
 
+	fflush(stdout);			/* builtin output goes first	*/
 	if ( (pid = fork())  == -1 ) {
 		perror("fork"); 
 	}
 	else if ( pid == 0 ) {
-		environ = VLtable2environ();
-		signal(SIGINT, SIG_DFL);
-		signal(SIGQUIT, SIG_DFL);
-
-		execvp(argv[0], argv); 
-		perror("cannot execute command");
-		exit(1);
+		exec_program(argv, 0);
 	} else {
-		if ( wait(&child_info) == -1 )
-			perror("wait");
+		while ( waitpid(pid, &child_info, 0) == -1 )
+			if ( errno != EINTR ) {	/* not a background job's */
+				perror("wait");
+				break;
+			}
 	}
 	return child_info;
 }
+
+static int wait_until(pid_t pid, int pidfd, struct timespec *end, int *infop)
+/*
+ * purpose: wait for pid to end, but no later than end (CLOCK_MONOTONIC)
+ * returns: 1 with its status in *infop if it ended, 0 if end came first
+ *  method: ppoll on its pidfd sleeps until it ends or until end, to the
+ *          nanosecond. Without a pidfd, look every 10ms.
+ */
+{
+	struct pollfd	pfd;
+	struct timespec	now, left;
+
+	pfd.fd = pidfd;
+	pfd.events = POLLIN;
+	for ( ;; ) {
+		if ( waitpid(pid, infop, WNOHANG) == pid )
+			return 1;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		left.tv_sec  = end->tv_sec - now.tv_sec;
+		left.tv_nsec = end->tv_nsec - now.tv_nsec;
+		if ( left.tv_nsec < 0 ) {
+			left.tv_sec--;
+			left.tv_nsec += 1000000000;
+		}
+		if ( left.tv_sec < 0 )
+			return 0;
+		if ( pidfd != -1 )
+			ppoll(&pfd, 1, &left, NULL);
+		else {
+			if ( left.tv_sec > 0 || left.tv_nsec > 10000000 ) {
+				left.tv_sec = 0;
+				left.tv_nsec = 10000000;
+			}
+			nanosleep(&left, NULL);
+		}
+	}
+}
+
+static void add_time(struct timespec *t, double secs)
+{
+	time_t	whole = (time_t) secs;
+
+	t->tv_sec  += whole;
+	t->tv_nsec += (long) ((secs - whole) * 1e9);
+	if ( t->tv_nsec >= 1000000000 ) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000;
+	}
+}
+
+int execute_timed(char **argv, struct builtin *cmd, double limit, int sig,
+								double grace)
+/*
+ * purpose: run a command in a child with a time limit in seconds
+ * returns: its exit status, 128 + n if signal n killed it, 124 if it was
+ *          still running after limit, 1 if it could not be started
+ *  action: the child gets a process group of its own. After limit the
+ *          group gets sig, and if grace is >= 0 and the child has not
+ *          ended grace seconds later, SIGKILL. A function or builtin is
+ *          run in the child as run_background does it.
+ */
+{
+	struct timespec	end;
+	int	pid, pidfd, child_info = 0, timed_out = 0;
+
+	fflush(stdout);
+	if ( (pid = fork()) == -1 ) {
+		perror("fork");
+		return 1;
+	}
+	if ( pid == 0 ) {
+		setpgid(0, 0);
+		run_in_child(argv, cmd, 0);
+	}
+
+	setpgid(pid, 0);			/* either may be first	*/
+	pidfd = syscall(SYS_pidfd_open, pid, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	add_time(&end, limit);
+	if ( !wait_until(pid, pidfd, &end, &child_info) ) {
+		timed_out = 1;
+		kill(-pid, sig);
+		if ( grace >= 0 )
+			add_time(&end, grace);
+		if ( grace < 0 || !wait_until(pid, pidfd, &end, &child_info) ) {
+			if ( grace >= 0 )
+				kill(-pid, SIGKILL);
+			while ( waitpid(pid, &child_info, 0) == -1 && errno == EINTR )
+				;
+		}
+	}
+	if ( pidfd != -1 )
+		close(pidfd);
+	if ( timed_out )
+		return 124;
+	if ( WIFSIGNALED(child_info) )
+		return 128 + WTERMSIG(child_info);
+	return WEXITSTATUS(child_info);
+}
+
+pid_t start_coproc(char **argv, struct builtin *cmd, int in, int out,
+							int *shut, int nshut)
+/*
+ * purpose: start a command with in as its stdin and out as its stdout
+ *          and leave it running
+ * returns: its pid, or -1 if the fork failed
+ *  action: a program is exec'd; a function or builtin is run in the
+ *          child as run_background does it. The caller keeps its ends
+ *          of the pipes away from later programs with O_CLOEXEC; the
+ *          nshut fds in shut are closed in the child before anything
+ *          runs, since a function or builtin is never exec'd. Its
+ *          stdout is line buffered there, so each line it prints
+ *          reaches the pipe as it is printed, not when it exits.
+ */
+{
+	pid_t	pid;
+	int	i;
+
+	fflush(stdout);
+	if ( (pid = fork()) == -1 ) {
+		perror("fork");
+		return -1;
+	}
+	if ( pid == 0 ) {
+		dup2(in, 0);
+		dup2(out, 1);
+		close(in);
+		close(out);
+		for ( i = 0 ; i < nshut ; i++ )
+			close(shut[i]);
+		setvbuf(stdout, NULL, _IOLBF, BUFSIZ);	/* empty: flushed */
+		run_in_child(argv, cmd, 0);
+	}
+	return pid;
+}
@@ -1,8 +1,17 @@
 #ifndef	PROCESS_H
 #define	PROCESS_H
 
+#include	<sys/types.h>
+
 int process(char **args);
-int do_command(char **args);
+struct builtin;
+
+int do_command(char **args, struct builtin *);
 int execute(char **args);
+int run_background(char **, int, struct builtin *);
+int execute_timed(char **, struct builtin *, double, int, double);
+pid_t start_coproc(char **, struct builtin *, int, int, int *, int);
+void proc_last(int);
+int proc_is_last();
 
 #endif
@@ -0,0 +1,207 @@
+/* reader.c - script input for smsh
+ *
+ *    rd_fromfp(rd, fp)          read lines from a stdio stream
+ *    rd_open(rd, path)          read lines from a file
+ *    rd_string(rd, str)         read lines from a string, for -c
+ *    rd_next(rd, prompt, &len)  next line as a (pointer, length) view
+ *    rd_words(rd)               that line already split, or NULL
+ *    rd_jump(rd)                where a then/else line's block ends
+ *    rd_seek(rd, n)             go on from line n
+ *    rd_at_end(rd)              is the last line read? only known for a
+ *                               file or a string
+ *    rd_close(rd)               done with it
+ *    rd_stdin_shared()          true while a script is read from stdin
+ *
+ *  a regular file is mapped read-only and each line is handed out as
+ *  a pointer into the mapping, so running a script costs no read()
+ *  calls and no copying. Anything else (a terminal, a pipe) goes
+ *  through stdio a line at a time into a buffer that is reused.
+ *
+ *  with SMSH_CACHE set a regular file is run from its precompiled form
+ *  (scache.c) instead, which also has the plain lines already split
+ *  and the ends of the if blocks. rd_words, rd_jump and rd_seek only
+ *  do something then.
+ *
+ *  the view returned by rd_next is NOT nul-terminated and is only
+ *  good until the next call.
+ */
+
+#define	_GNU_SOURCE
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<ctype.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"reader.h"
+#include	"scache.h"
+
+static int	on_stdin = 0;		/* readers using stdin		*/
+
+void rd_fromfp(struct reader *rd, FILE *fp)
+{
+	if ( fp == stdin )
+		on_stdin++;
+	rd->fp   = fp;
+	rd->sc   = NULL;
+	rd->map  = NULL;
+	rd->mapped = 0;
+	rd->size = rd->pos = 0;
+	fs_init(&rd->line, BUFSIZ);
+}
+
+void rd_string(struct reader *rd, char *str)
+/*
+ * lines from str, served as from a mapping. str is not copied.
+ */
+{
+	rd_fromfp(rd, NULL);
+	rd->map  = str;
+	rd->size = strlen(str);
+}
+
+int rd_open(struct reader *rd, char *path)
+/*
+ * purpose: open a script file, mapping it if it is a regular file
+ * returns: 0 for ok, -1 on error with errno set
+ */
+{
+	struct stat info;
+	FILE	*fp;
+	char	*map;
+	int	fd;
+
+	if ( (fd = open(path, O_RDONLY)) == -1 )
+		return -1;
+	if ( fstat(fd, &info) == -1 ) {
+		close(fd);
+		return -1;
+	}
+	rd_fromfp(rd, NULL);
+	if ( S_ISREG(info.st_mode) && (rd->sc = sc_open(path, fd, &info)) != NULL ) {
+		close(fd);
+		return 0;
+	}
+	if ( S_ISREG(info.st_mode) && info.st_size > 0
+	     && (map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+							!= MAP_FAILED ) {
+		madvise(map, info.st_size, MADV_SEQUENTIAL);
+		close(fd);				/* map stays	*/
+		rd->map  = map;
+		rd->mapped = 1;
+		rd->size = info.st_size;
+		return 0;
+	}
+	if ( (fp = fdopen(fd, "r")) == NULL ) {		/* pipe, tty..	*/
+		close(fd);
+		return -1;
+	}
+	rd_fromfp(rd, fp);
+	return 0;
+}
+
+char *rd_next(struct reader *rd, char *prompt, size_t *lenp)
+/*
+ * purpose: get the next line, without its newline
+ * returns: pointer to the line, its length in *lenp, NULL at EOF
+ */
+{
+	char	*line, *nl;
+	int	c, tag;
+
+	if ( rd->sc != NULL )				/* precompiled	*/
+		return sc_next(rd->sc, lenp);
+	if ( rd->fp == NULL ) {				/* mapped	*/
+		if ( rd->pos >= rd->size )
+			return NULL;
+		line = rd->map + rd->pos;
+		nl = memchr(line, '\n', rd->size - rd->pos);
+		*lenp = ( nl ? nl - line : rd->size - rd->pos );
+		rd->pos += *lenp + 1;
+		return line;
+	}
+
+	rd->line.fs_used = 0;				/* reuse buffer	*/
+	printf("%s", prompt);
+	tag = mem_tag(MT_READER);
+	while ( (c = getc(rd->fp)) != EOF && c != '\n' )
+		fs_addch(&rd->line, c);
+	mem_tag(tag);
+	if ( c == EOF && rd->line.fs_used == 0 )
+		return NULL;
+	*lenp = rd->line.fs_used;
+	return fs_getstr(&rd->line);
+}
+
+char **rd_words(struct reader *rd)
+/*
+ * returns the words of the line rd_next gave last if they are known
+ * already, else NULL. They are not to be freed.
+ */
+{
+	return ( rd->sc ? sc_words(rd->sc) : NULL );
+}
+
+int rd_jump(struct reader *rd)
+/*
+ * returns for a then or else line the line that ends its block,
+ * -1 if that is not known
+ */
+{
+	return ( rd->sc ? sc_jump(rd->sc) : -1 );
+}
+
+void rd_seek(struct reader *rd, int n)
+{
+	if ( rd->sc != NULL )
+		sc_seek(rd->sc, n);
+}
+
+int rd_at_end(struct reader *rd)
+/*
+ * returns true if the line rd_next gave last was the last one, blank
+ * lines after it aside. A stream can not say, so it is never at end.
+ */
+{
+	size_t	i;
+
+	if ( rd->sc != NULL )
+		return sc_at_end(rd->sc);
+	if ( rd->fp != NULL )
+		return 0;
+	for ( i = rd->pos ; i < rd->size ; i++ )
+		if ( !isspace((unsigned char) rd->map[i]) )
+			return 0;
+	return 1;
+}
+
+void rd_close(struct reader *rd)
+{
+	if ( rd->sc != NULL )
+		sc_close(rd->sc);
+	else if ( rd->mapped )
+		munmap(rd->map, rd->size);
+	else if ( rd->fp != NULL && rd->fp != stdin )
+		fclose(rd->fp);
+	else if ( rd->fp == stdin )
+		on_stdin--;
+	fs_free(&rd->line);
+	rd->sc  = NULL;
+	rd->map = NULL;
+	rd->mapped = 0;
+	rd->fp  = NULL;
+}
+
+int rd_stdin_shared()
+/*
+ * returns true if script lines are coming from stdin through stdio,
+ * so anything else reading fd 0 has to go through stdin too
+ */
+{
+	return on_stdin > 0;
+}
@@ -0,0 +1,32 @@
+#ifndef	READER_H
+#define	READER_H
+/*
+ * header for reader.c - where script lines come from
+ */
+#include	<stdio.h>
+#include	"flexstr.h"
+
+struct script_cache;
+
+struct reader {
+		FILE	*fp;		/* stdio input, NULL if mapped	*/
+		struct script_cache *sc; /* precompiled, or NULL	*/
+		char	*map;		/* the mapped script		*/
+		int	mapped;		/* 0 if map is a string		*/
+		size_t	size;		/* bytes in map			*/
+		size_t	pos;		/* next unread byte in map	*/
+		FLEXSTR	line;		/* line buffer for stdio input	*/
+	};
+
+void	rd_fromfp(struct reader *, FILE *);
+int	rd_open(struct reader *, char *);
+void	rd_string(struct reader *, char *);
+char	*rd_next(struct reader *, char *, size_t *);
+char	**rd_words(struct reader *);
+int	rd_jump(struct reader *);
+void	rd_seek(struct reader *, int);
+int	rd_at_end(struct reader *);
+void	rd_close(struct reader *);
+int	rd_stdin_shared();
+
+#endif
@@ -0,0 +1,447 @@
+/* scache.c - precompiled script files for smsh
+ *
+ *    sc_open(path, fd, &info)   the precompiled form of a script
+ *    sc_next(sc, &len)          next line as a (pointer, length) view
+ *    sc_words(sc)               that line already split, or NULL
+ *    sc_jump(sc)                for a then or else line, the line of
+ *                               the else or fi that ends its block
+ *    sc_seek(sc, n)             go on from line n
+ *    sc_at_end(sc)              only blank lines left?
+ *    sc_close(sc)               done with it
+ *
+ *  when SMSH_CACHE is set, a script is split once and the result is
+ *  saved in a cache file. Later runs map that file and take the lines
+ *  and their words from it, so nothing is read or split again. The
+ *  cache goes next to the script, as script.smc, when SMSH_CACHE is
+ *  "." and into the directory SMSH_CACHE names otherwise.
+ *
+ *  a cache is only used if the script's size and mtime are the ones
+ *  recorded in it and it has this file's SC_VERSION; otherwise it is
+ *  made again. If it cannot be written the script still runs from the
+ *  form made in memory.
+ *
+ *  the file is
+ *	header
+ *	struct sc_line	lines[nlines]
+ *	uint32_t	words[nwords]	string offsets, SC_END after
+ *					the words of each line
+ *	char		strings[strsize]
+ *  the text of every line is in strings too, so the script itself is
+ *  not opened on a later run. A line with $, \ or a wildcard in it is
+ *  expanded and split when it runs, like before; it has no words here.
+ *  Nor has a list, which cl_run cuts up when it runs.
+ */
+
+#define	_GNU_SOURCE
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<ctype.h>
+#include	<stdint.h>
+#include	<fcntl.h>
+#include	<limits.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"scache.h"
+#include	"cmdlist.h"
+#include	"function.h"
+
+#define	SC_MAGIC	"smc"
+#define	SC_VERSION	4		/* change with the layout	*/
+#define	SC_END		0xffffffffu
+
+struct sc_header {
+		char	magic[4];
+		uint32_t version;
+		uint64_t size;		/* of the script		*/
+		int64_t	mtime_sec;	/* of the script		*/
+		int64_t	mtime_nsec;
+		uint32_t nlines;
+		uint32_t nwords;
+		uint32_t strsize;
+		uint32_t unused;
+	};
+
+struct sc_line {
+		uint32_t text;		/* offset in strings		*/
+		uint32_t len;
+		int32_t	words;		/* index in words, -1 if none	*/
+		int32_t	jump;		/* line to go to, -1 if none	*/
+	};
+
+struct script_cache {
+		char	*image;		/* the whole file		*/
+		size_t	size;
+		int	mapped;		/* else malloced		*/
+		struct sc_line *lines;
+		int	nlines;
+		char	*strings;
+		char	**words;	/* words[] as pointers		*/
+		int	cur;		/* next line			*/
+	};
+
+struct grow {				/* a buffer that grows		*/
+		char	*p;
+		size_t	n, max;
+	};
+
+static void add(struct grow *g, void *data, size_t len)
+{
+	if ( g->n + len > g->max ) {
+		while ( g->n + len > g->max )
+			g->max = g->max ? 2 * g->max : 4096;
+		g->p = erealloc(g->p, g->max);
+	}
+	memcpy(g->p + g->n, data, len);
+	g->n += len;
+}
+
+static char *cache_path(char *path)
+/*
+ * returns the name of the cache file for path, NULL if caching is off
+ */
+{
+	char	*dir = getenv("SMSH_CACHE"), *rv, *cp, full[PATH_MAX];
+
+	if ( dir == NULL || *dir == '\0' )
+		return NULL;
+	if ( strcmp(dir, ".") == 0 ) {
+		rv = emalloc(strlen(path) + 5);
+		sprintf(rv, "%s.smc", path);
+		return rv;
+	}
+	if ( realpath(path, full) == NULL )
+		return NULL;
+	for ( cp = full ; *cp ; cp++ )		/* one flat directory	*/
+		if ( *cp == '/' )
+			*cp = '%';
+	rv = emalloc(strlen(dir) + strlen(full) + 6);
+	sprintf(rv, "%s/%s.smc", dir, full);
+	return rv;
+}
+
+static int is_plain(char *line, size_t len)
+/*
+ * can the line be split once and for all?
+ */
+{
+	size_t	i;
+
+	for ( i = 0 ; i < len ; i++ )
+		if ( line[i] != '\0' && strchr("$\\*?[;&|({", line[i]) != NULL )
+			return 0;
+	return 1;
+}
+
+static void set_jump(struct grow *lines, int from, int to)
+{
+	if ( from >= 0 && to > from )		/* not within a line	*/
+		((struct sc_line *) lines->p)[from].jump = to;
+}
+
+static void note_keyword(char *w, int n, struct grow *lines, struct grow *ifs)
+/*
+ * w starts a command on line n. ifs is the stack of open ifs, each
+ * with its then or else line still waiting for the end of its block
+ */
+{
+	int	*top = NULL, none = -1;
+
+	if ( ifs->n > 0 )
+		top = (int *) (ifs->p + ifs->n) - 1;
+	if ( strcmp(w, "if") == 0 )
+		add(ifs, &none, sizeof(none));
+	else if ( top && strcmp(w, "then") == 0 )
+		*top = n;
+	else if ( top && strcmp(w, "else") == 0 ) {
+		set_jump(lines, *top, n);
+		*top = n;
+	}
+	else if ( top && strcmp(w, "fi") == 0 ) {
+		set_jump(lines, *top, n);
+		ifs->n -= sizeof(int);
+	}
+}
+
+static char *build(char *src, size_t size, struct stat *info, size_t *lenp)
+/*
+ * purpose: make the precompiled form of a script
+ * returns: the image of the cache file, its length in *lenp
+ *  method: split every line; keep the words of the plain ones. For
+ *          jumps keep a stack with, for each open if, the then or
+ *          else line still waiting for the line that ends its block.
+ *          Each command of a list line counts, so  if a; then  works.
+ *          The ifs in a function body are left alone: they do not
+ *          run where they are read.
+ */
+{
+	struct grow lines = { 0 }, words = { 0 }, strs = { 0 }, out = { 0 };
+	struct grow ifs = { 0 };
+	struct cmdlist cl = { NULL, 0, 0 };
+	struct sc_header hdr;
+	struct sc_line ln;
+	char	*line, *nl, **wl, **wp, **kw;
+	size_t	pos, len;
+	uint32_t off, end = SC_END;
+	int	i, n = 0, body = 0;
+
+	for ( pos = 0 ; pos < size ; pos += len + 1, n++ ) {
+		line = src + pos;
+		nl = memchr(line, '\n', size - pos);
+		len = ( nl ? nl - line : size - pos );
+		ln.text  = strs.n;
+		ln.len   = len;
+		ln.words = -1;
+		ln.jump  = -1;
+		add(&strs, line, len);
+		add(&strs, "", 1);
+
+		wl = splitline_n(line, len);
+		if ( wl != NULL && is_plain(line, len) ) {
+			ln.words = words.n / sizeof(uint32_t);
+			for ( wp = wl ; *wp != NULL ; wp++ ) {
+				off = strs.n;
+				add(&words, &off, sizeof(off));
+				add(&strs, *wp, strlen(*wp) + 1);
+			}
+			add(&words, &end, sizeof(end));
+		}
+		add(&lines, &ln, sizeof(ln));
+
+		if ( body > 0 || (wl != NULL && is_function_def(wl)) ) {
+			if ( wl != NULL && wl[0] != NULL )	/* not our ifs	*/
+				body += ( strcmp(wl[0], "}") == 0 ? -1
+						: is_function_def(wl) );
+		}
+		else if ( wl != NULL && cl_find(line, len)
+				&& cl_split(line, len, &cl) > 0 ) {
+			for ( i = 0 ; i < cl.n ; i++ ) {	/* a list	*/
+				kw = splitline_n(cl.parts[i].text, cl.parts[i].len);
+				if ( kw != NULL && kw[0] != NULL )
+					note_keyword(kw[0], n, &lines, &ifs);
+				if ( kw != NULL )
+					freelist(kw);
+			}
+		}
+		else if ( wl != NULL && wl[0] != NULL )
+			note_keyword(wl[0], n, &lines, &ifs);
+		if ( wl != NULL )
+			freelist(wl);
+	}
+	efree(ifs.p);
+	efree(cl.parts);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SC_MAGIC, sizeof(SC_MAGIC));
+	hdr.version    = SC_VERSION;
+	hdr.size       = info->st_size;
+	hdr.mtime_sec  = info->st_mtim.tv_sec;
+	hdr.mtime_nsec = info->st_mtim.tv_nsec;
+	hdr.nlines     = n;
+	hdr.nwords     = words.n / sizeof(uint32_t);
+	hdr.strsize    = strs.n;
+	add(&out, &hdr, sizeof(hdr));
+	add(&out, lines.p, lines.n);
+	add(&out, words.p, words.n);
+	add(&out, strs.p, strs.n);
+	efree(lines.p);
+	efree(words.p);
+	efree(strs.p);
+	*lenp = out.n;
+	return out.p;
+}
+
+static void save(char *cpath, char *image, size_t len)
+/*
+ * write the cache under a temporary name and rename it into place,
+ * so a reader never sees half a file. Failing is not an error.
+ */
+{
+	char	*tmp = emalloc(strlen(cpath) + 24);
+	int	fd, ok;
+
+	sprintf(tmp, "%s.%d", cpath, (int) getpid());
+	if ( (fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) != -1 ) {
+		ok = ( write(fd, image, len) == (ssize_t) len );
+		ok = ( close(fd) == 0 && ok );
+		if ( !ok || rename(tmp, cpath) == -1 )
+			unlink(tmp);
+	}
+	efree(tmp);
+}
+
+static struct script_cache *use(char *image, size_t size, int mapped)
+/*
+ * purpose: check an image and set up to run from it
+ * returns: the cache, or NULL if the image does not hang together
+ */
+{
+	struct sc_header *hp = (struct sc_header *) image;
+	struct script_cache *sc;
+	struct sc_line *lp;
+	uint32_t *wt, i, j;
+	int	ok = 1;
+
+	if ( size < sizeof(*hp) || size != sizeof(*hp)
+			+ (size_t) hp->nlines * sizeof(struct sc_line)
+			+ (size_t) hp->nwords * sizeof(uint32_t) + hp->strsize )
+		return NULL;
+	sc = emalloc(sizeof(struct script_cache));
+	sc->image   = image;
+	sc->size    = size;
+	sc->mapped  = mapped;
+	sc->lines   = (struct sc_line *) (image + sizeof(*hp));
+	sc->nlines  = hp->nlines;
+	wt = (uint32_t *) (sc->lines + hp->nlines);
+	sc->strings = (char *) (wt + hp->nwords);
+	sc->words   = emalloc((hp->nwords + 1) * sizeof(char *));
+	sc->cur     = 0;
+	sc->words[hp->nwords] = NULL;
+	ok = ( hp->strsize == 0 || sc->strings[hp->strsize - 1] == '\0' );
+	for ( i = 0 ; ok && i < hp->nwords ; i++ ) {
+		ok = ( wt[i] == SC_END || wt[i] < hp->strsize );
+		sc->words[i] = ( wt[i] == SC_END ? NULL : sc->strings + wt[i] );
+	}
+	for ( i = 0 ; ok && i < hp->nlines ; i++ ) {
+		lp = &sc->lines[i];
+		ok = ( (uint64_t) lp->text + lp->len < hp->strsize
+			&& lp->words >= -1 && lp->words < (int32_t) hp->nwords
+			&& lp->jump >= -1 && lp->jump < (int32_t) hp->nlines );
+		if ( ok && lp->words >= 0 ) {	/* its run ends in SC_END */
+			for ( j = lp->words ; j < hp->nwords && wt[j] != SC_END ; j++ )
+				;
+			ok = ( j < hp->nwords );
+		}
+	}
+	if ( !ok ) {				/* damaged	*/
+		efree(sc->words);
+		efree(sc);
+		return NULL;
+	}
+	return sc;
+}
+
+static struct script_cache *load(char *cpath, struct stat *info)
+/*
+ * map the cache file if it is there and up to date
+ */
+{
+	struct sc_header *hp;
+	struct script_cache *sc = NULL;
+	struct stat cinfo;
+	char	*image;
+	int	fd;
+
+	if ( (fd = open(cpath, O_RDONLY|O_CLOEXEC)) == -1 )
+		return NULL;
+	if ( fstat(fd, &cinfo) == -1 || cinfo.st_size < (off_t) sizeof(*hp)
+	     || (image = mmap(NULL, cinfo.st_size, PROT_READ|PROT_WRITE,
+				MAP_PRIVATE, fd, 0)) == MAP_FAILED ) {
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	hp = (struct sc_header *) image;
+	if ( memcmp(hp->magic, SC_MAGIC, sizeof(SC_MAGIC)) == 0
+	     && hp->version == SC_VERSION
+	     && hp->size == (uint64_t) info->st_size
+	     && hp->mtime_sec == info->st_mtim.tv_sec
+	     && hp->mtime_nsec == info->st_mtim.tv_nsec )
+		sc = use(image, cinfo.st_size, 1);
+	if ( sc == NULL )
+		munmap(image, cinfo.st_size);
+	return sc;
+}
+
+struct script_cache *sc_open(char *path, int fd, struct stat *info)
+/*
+ * purpose: get the precompiled form of the script path, open on fd
+ * returns: the cache, or NULL if caching is off or not possible
+ */
+{
+	struct script_cache *sc = NULL;
+	char	*cpath, *src, *image;
+	size_t	len;
+	int	tag;
+
+	if ( info->st_size == 0 || (cpath = cache_path(path)) == NULL )
+		return NULL;
+	tag = mem_tag(MT_READER);
+	if ( (sc = load(cpath, info)) == NULL &&
+	     (src = mmap(NULL, info->st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+							!= MAP_FAILED ) {
+		image = build(src, info->st_size, info, &len);
+		munmap(src, info->st_size);
+		save(cpath, image, len);
+		if ( (sc = use(image, len, 0)) == NULL )
+			efree(image);
+	}
+	efree(cpath);
+	mem_tag(tag);
+	return sc;
+}
+
+char *sc_next(struct script_cache *sc, size_t *lenp)
+{
+	struct sc_line *lp;
+
+	if ( sc->cur >= sc->nlines )
+		return NULL;
+	lp = &sc->lines[sc->cur++];
+	*lenp = lp->len;
+	return sc->strings + lp->text;
+}
+
+char **sc_words(struct script_cache *sc)
+/*
+ * returns the words of the line sc_next gave last, NULL if it has to
+ * be expanded first. They belong to the cache: do not free them.
+ */
+{
+	int	w = sc->lines[sc->cur - 1].words;
+
+	return ( w >= 0 ? sc->words + w : NULL );
+}
+
+int sc_jump(struct script_cache *sc)
+{
+	return sc->lines[sc->cur - 1].jump;
+}
+
+void sc_seek(struct script_cache *sc, int n)
+{
+	sc->cur = n;
+}
+
+int sc_at_end(struct script_cache *sc)
+/*
+ * returns true if only blank lines are left
+ */
+{
+	struct sc_line *lp;
+	char	*p;
+
+	for ( lp = sc->lines + sc->cur ; lp < sc->lines + sc->nlines ; lp++ )
+		for ( p = sc->strings + lp->text ; p < sc->strings + lp->text
+							+ lp->len ; p++ )
+			if ( !isspace((unsigned char) *p) )
+				return 0;
+	return 1;
+}
+
+void sc_close(struct script_cache *sc)
+{
+	int	tag = mem_tag(MT_READER);
+
+	if ( sc->mapped )
+		munmap(sc->image, sc->size);
+	else
+		efree(sc->image);
+	efree(sc->words);
+	efree(sc);
+	mem_tag(tag);
+}
@@ -0,0 +1,19 @@
+#ifndef	SCACHE_H
+#define	SCACHE_H
+/*
+ * header for scache.c - precompiled script files
+ */
+#include	<stddef.h>
+#include	<sys/stat.h>
+
+struct script_cache;
+
+struct script_cache *sc_open(char *, int, struct stat *);
+char	*sc_next(struct script_cache *, size_t *);
+char	**sc_words(struct script_cache *);
+int	sc_jump(struct script_cache *);
+void	sc_seek(struct script_cache *, int);
+int	sc_at_end(struct script_cache *);
+void	sc_close(struct script_cache *);
+
+#endif
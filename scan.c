@@ -0,0 +1,164 @@
+/* scan.c - finding special chars in a line
+ *
+ *    scan_any( s, n, set )   the offset of the first char of s[0..n) that
+ *                            is in the string set, n if there is none
+ *    scan_use( level )       scan with SCAN_BYTES, SCAN_SSE2 or SCAN_AVX2,
+ *                            or the best the cpu has if level < 0;
+ *                            returns the level it got
+ *
+ *  splitline, the expansion pass and cmdlist all look through a line
+ *  for a few chars: a blank, a $ or \, a list operator or a #. Most
+ *  of a long line is none of those, so instead of testing each char
+ *  scan_any compares 16 chars at a time with SSE2, or 32 with AVX2,
+ *  against each char of set, and jumps to the first that matched.
+ *
+ *  the code is picked the first time scan_any is called, from what
+ *  the cpu says it has. Off x86, and for pieces shorter than a vector,
+ *  the chars are looked at one at a time.
+ */
+
+#include	<string.h>
+#include	"scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define	SCAN_X86
+#include	<immintrin.h>
+#endif
+
+#define	MAXSET	16			/* most chars in a set	*/
+
+static size_t	pick(char *, size_t, char *, int);
+static size_t	(*scanner)(char *, size_t, char *, int) = pick;
+
+static size_t scan_bytes(char *s, size_t n, char *set, int m)
+/*
+ * a char at a time, each looked up in a bit map of set
+ */
+{
+	unsigned char map[32], c;
+	size_t	i;
+
+	memset(map, 0, sizeof(map));
+	while ( m-- > 0 ) {
+		c = set[m];
+		map[c >> 3] |= 1 << (c & 7);
+	}
+	for ( i = 0 ; i < n ; i++ ) {
+		c = s[i];
+		if ( map[c >> 3] & (1 << (c & 7)) )
+			return i;
+	}
+	return n;
+}
+
+#ifdef	SCAN_X86
+__attribute__((target("sse2")))
+static size_t scan_sse2(char *s, size_t n, char *set, int m)
+{
+	__m128i	want[MAXSET], v, hit;
+	size_t	i;
+	int	j, mask;
+
+	for ( j = 0 ; j < m ; j++ )
+		want[j] = _mm_set1_epi8(set[j]);
+	for ( i = 0 ; i + 16 <= n ; i += 16 ) {
+		v = _mm_loadu_si128((__m128i *) (s + i));
+		hit = _mm_cmpeq_epi8(v, want[0]);
+		for ( j = 1 ; j < m ; j++ )
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, want[j]));
+		if ( (mask = _mm_movemask_epi8(hit)) != 0 )
+			return i + __builtin_ctz(mask);
+	}
+	return i + scan_bytes(s + i, n - i, set, m);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(char *s, size_t n, char *set, int m)
+{
+	__m256i	want[MAXSET], v, hit;
+	size_t	i;
+	int	j;
+	unsigned mask;
+
+	for ( j = 0 ; j < m ; j++ )
+		want[j] = _mm256_set1_epi8(set[j]);
+	for ( i = 0 ; i + 32 <= n ; i += 32 ) {
+		v = _mm256_loadu_si256((__m256i *) (s + i));
+		hit = _mm256_cmpeq_epi8(v, want[0]);
+		for ( j = 1 ; j < m ; j++ )
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, want[j]));
+		if ( (mask = _mm256_movemask_epi8(hit)) != 0 )
+			return i + __builtin_ctz(mask);
+	}
+	if ( i + 16 <= n ) {			/* a last half vector	*/
+		__m128i	v16 = _mm_loadu_si128((__m128i *) (s + i)),
+			hit16 = _mm_setzero_si128();
+
+		for ( j = 0 ; j < m ; j++ )
+			hit16 = _mm_or_si128(hit16, _mm_cmpeq_epi8(v16,
+					_mm256_castsi256_si128(want[j])));
+		if ( (mask = _mm_movemask_epi8(hit16)) != 0 )
+			return i + __builtin_ctz(mask);
+		i += 16;
+	}
+	_mm256_zeroupper();			/* no stall in the sse code */
+	return i + scan_bytes(s + i, n - i, set, m);
+}
+#endif
+
+int scan_use(int level)
+/*
+ * purpose: choose the code scan_any uses
+ * returns: the level chosen, which is never more than the cpu can do
+ */
+{
+	int	best = SCAN_BYTES;
+
+#ifdef	SCAN_X86
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") )
+		best = SCAN_AVX2;
+	else if ( __builtin_cpu_supports("sse2") )
+		best = SCAN_SSE2;
+#endif
+	if ( level < 0 || level > best )
+		level = best;
+	switch ( level ) {
+#ifdef	SCAN_X86
+	case SCAN_AVX2:
+		scanner = scan_avx2;
+		break;
+	case SCAN_SSE2:
+		scanner = scan_sse2;
+		break;
+#endif
+	default:
+		scanner = scan_bytes;
+	}
+	return level;
+}
+
+static size_t pick(char *s, size_t n, char *set, int m)
+/*
+ * the first call: choose, then scan
+ */
+{
+	scan_use(-1);
+	return scanner(s, n, set, m);
+}
+
+size_t scan_any(char *s, size_t n, char *set)
+/*
+ * purpose: find the first char of s[0..n) that is one of the chars of set
+ * returns: its offset, or n if there is none
+ *    note: set holds at most MAXSET chars; s need not end in a nul
+ */
+{
+	int	m = strlen(set);
+
+	if ( m > MAXSET )
+		m = MAXSET;
+	if ( n < 16 )				/* not worth a vector	*/
+		return scan_bytes(s, n, set, m);
+	return scanner(s, n, set, m);
+}
@@ -0,0 +1,15 @@
+#ifndef	SCAN_H
+#define	SCAN_H
+/*
+ * header for scan.c - finding special chars in a line
+ */
+#include	<stddef.h>
+
+#define	SCAN_BYTES	0		/* the levels for scan_use	*/
+#define	SCAN_SSE2	1
+#define	SCAN_AVX2	2
+
+size_t	scan_any(char *, size_t, char *);
+int	scan_use(int);
+
+#endif
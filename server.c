@@ -0,0 +1,336 @@
+/* server.c - smsh as a resident server on a Unix socket
+ *
+ *    serve( path )               smsh --serve path: run scripts sent to
+ *                                the socket at path, never returns
+ *    client( path, argc, argv )  smsh --client path script args...: have
+ *                                the server run the script, returns its
+ *                                exit status
+ *
+ *  the server is set up once, as any smsh is, and then forks a child
+ *  for each connection. The child starts with the variable table and
+ *  its index, the builtin hash and anything else the parent has made,
+ *  so a request costs a fork and not a new process image.
+ *
+ *  a request is a 4 byte length and then the client's working directory
+ *  and argv, each ended by a NUL. The client's fds 0, 1 and 2 come with
+ *  the first bytes as SCM_RIGHTS, and the child makes them its own
+ *  before running the script, so output goes where the client's would.
+ *  The reply is the script's exit status as 4 bytes.
+ *
+ *  the socket is made mode 0600 before it listens, and a connection
+ *  from a process of another user is closed unread, as SO_PEERCRED
+ *  tells it, so only the server's own user can have scripts run.
+ *
+ *  the server does not wait for a child in line. Each child gets a
+ *  pidfd, and one poll covers the listening socket and every pidfd;
+ *  when a child ends its status is sent on its connection, even if the
+ *  script ended with exit or was killed. Without pidfd_open a request
+ *  is waited for before the next is taken.
+ */
+
+#define	_GNU_SOURCE
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<poll.h>
+#include	<signal.h>
+#include	<stdint.h>
+#include	<unistd.h>
+#include	<sys/socket.h>
+#include	<sys/stat.h>
+#include	<sys/syscall.h>
+#include	<sys/un.h>
+#include	<sys/wait.h>
+
+#include	"smsh.h"
+#include	"varlib.h"
+#include	"memstat.h"
+#include	"server.h"
+
+#define	MAXREQ		65536		/* longest cwd and argv	*/
+
+struct conn {
+		pid_t	pid;		/* the child running it	*/
+		int	pidfd;
+		int	sock;		/* where the status goes */
+	};
+
+static struct conn *conns = NULL;
+static int	nconns = 0, maxconns = 0;
+
+static int unix_addr(struct sockaddr_un *sa, char *path)
+{
+	if ( strlen(path) >= sizeof(sa->sun_path) ) {
+		fprintf(stderr, "smsh: %s: socket path too long\n", path);
+		return -1;
+	}
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	strcpy(sa->sun_path, path);
+	return 0;
+}
+
+static int full_io(int fd, char *buf, size_t len, int out)
+/*
+ * read or write all len bytes, returns 0 for ok, -1 if not
+ */
+{
+	ssize_t	n;
+
+	while ( len > 0 ) {
+		n = out ? write(fd, buf, len) : read(fd, buf, len);
+		if ( n == -1 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void run_request(int sock)
+/*
+ * purpose: in the child, take a request off sock and run it
+ * returns: does not, the child exits with the script's status
+ */
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	char	ctl[CMSG_SPACE(3 * sizeof(int))], *buf, **argv;
+	int	fds[3], i, argc;
+	uint32_t len;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &len;
+	iov.iov_len = sizeof(len);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl;
+	msg.msg_controllen = sizeof(ctl);
+	if ( recvmsg(sock, &msg, MSG_WAITALL) != sizeof(len)
+			|| (cm = CMSG_FIRSTHDR(&msg)) == NULL
+			|| cm->cmsg_type != SCM_RIGHTS
+			|| cm->cmsg_len != CMSG_LEN(3 * sizeof(int))
+			|| len == 0 || len > MAXREQ )
+		_exit(2);
+	memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+	buf = emalloc(len + 1);
+	if ( full_io(sock, buf, len, 0) == -1 )
+		_exit(2);
+	buf[len] = '\0';
+	close(sock);
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		dup2(fds[i], i);
+		if ( fds[i] > 2 )
+			close(fds[i]);
+	}
+	for ( argc = 0, i = strlen(buf) + 1 ; i < len ; i += strlen(buf + i) + 1 )
+		argc++;
+	argv = emalloc((argc + 1) * sizeof(char *));
+	for ( argc = 0, i = strlen(buf) + 1 ; i < len ; i += strlen(buf + i) + 1 )
+		argv[argc++] = buf + i;
+	argv[argc] = NULL;
+	if ( argc == 0 || chdir(buf) == -1 ) {
+		fprintf(stderr, "smsh: bad request\n");
+		exit(2);
+	}
+	VLinit();				/* $$ is this script's	*/
+	exit(run_script(argc, argv));
+}
+
+static void send_status(struct conn *cp, int status)
+/*
+ * the reply to a request, and the end of its connection
+ */
+{
+	uint32_t s;
+
+	if ( WIFSIGNALED(status) )
+		s = 128 + WTERMSIG(status);
+	else
+		s = WEXITSTATUS(status);
+	full_io(cp->sock, (char *) &s, sizeof(s), 1);
+	close(cp->sock);
+	if ( cp->pidfd != -1 )
+		close(cp->pidfd);
+	*cp = conns[--nconns];
+}
+
+static int same_user(int sock)
+/*
+ * is the peer on sock running as our user?
+ */
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	return getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0
+		&& cred.uid == getuid();
+}
+
+static void new_conn(int lsock)
+/*
+ * accept a connection and fork the child for it
+ */
+{
+	struct conn *cp;
+	int	sock, status, i;
+	pid_t	pid;
+
+	if ( (sock = accept4(lsock, NULL, NULL, SOCK_CLOEXEC)) == -1 )
+		return;
+	if ( !same_user(sock) ) {
+		close(sock);
+		return;
+	}
+	fflush(stdout);
+	if ( (pid = fork()) == -1 ) {
+		perror("fork");
+		close(sock);
+		return;
+	}
+	if ( pid == 0 ) {
+		close(lsock);
+		for ( i = 0 ; i < nconns ; i++ ) {
+			close(conns[i].sock);
+			close(conns[i].pidfd);
+		}
+		run_request(sock);
+	}
+	if ( nconns == maxconns ) {
+		maxconns = maxconns ? 2 * maxconns : 16;
+		i = mem_tag(MT_JOBS);
+		conns = erealloc(conns, maxconns * sizeof(struct conn));
+		mem_tag(i);
+	}
+	cp = &conns[nconns++];
+	cp->pid   = pid;
+	cp->sock  = sock;
+	cp->pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if ( cp->pidfd == -1 ) {		/* no pidfds: wait now	*/
+		while ( waitpid(pid, &status, 0) == -1 && errno == EINTR )
+			;
+		send_status(cp, status);
+	}
+}
+
+int serve(char *path)
+/*
+ * purpose: listen on path and run each script sent to it
+ * returns: 1 if the socket can not be set up, else does not return
+ */
+{
+	struct sockaddr_un sa;
+	struct pollfd *pfds = NULL;
+	int	lsock, i, status, tag;
+
+	if ( unix_addr(&sa, path) == -1 )
+		return 1;
+	unlink(path);
+	if ( (lsock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1
+			|| bind(lsock, (struct sockaddr *) &sa, sizeof(sa)) == -1
+			|| chmod(path, 0600) == -1	/* before anyone connects */
+			|| listen(lsock, 64) == -1 ) {
+		perror(path);
+		return 1;
+	}
+	VLlookup("PATH");			/* load the environment	*/
+	for ( ;; ) {
+		tag = mem_tag(MT_JOBS);
+		pfds = erealloc(pfds, (nconns + 1) * sizeof(struct pollfd));
+		mem_tag(tag);
+		pfds[0].fd = lsock;
+		pfds[0].events = POLLIN;
+		for ( i = 0 ; i < nconns ; i++ ) {
+			pfds[i+1].fd = conns[i].pidfd;
+			pfds[i+1].events = POLLIN;
+		}
+		if ( poll(pfds, nconns + 1, -1) == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			perror("poll");
+			return 1;
+		}
+		for ( i = nconns - 1 ; i >= 0 ; i-- )	/* send_status moves */
+			if ( pfds[i+1].revents != 0
+				&& waitpid(conns[i].pid, &status, WNOHANG) > 0 )
+				send_status(&conns[i], status);
+		if ( pfds[0].revents & POLLIN )
+			new_conn(lsock);
+	}
+}
+
+int client(char *path, int argc, char **argv)
+/*
+ * purpose: send a script and its args to the server at path, with our
+ *          fds 0, 1 and 2
+ * returns: the script's exit status, 2 if the server could not run it
+ */
+{
+	struct sockaddr_un sa;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	char	ctl[CMSG_SPACE(3 * sizeof(int))], cwd[4096];
+	int	sock, i, fds[3] = { 0, 1, 2 };
+	uint32_t len, status;
+	size_t	n;
+	char	*buf;
+
+	if ( argc < 1 ) {
+		fprintf(stderr, "usage: smsh --client socket script [args]\n");
+		return 2;
+	}
+	signal(SIGPIPE, SIG_IGN);		/* a refused request: EPIPE */
+	if ( getcwd(cwd, sizeof(cwd)) == NULL ) {
+		perror("getcwd");
+		return 2;
+	}
+	for ( len = strlen(cwd) + 1, i = 0 ; i < argc ; i++ )
+		len += strlen(argv[i]) + 1;
+	if ( len > MAXREQ ) {
+		fprintf(stderr, "smsh: argument list too long\n");
+		return 2;
+	}
+	buf = emalloc(len);
+	for ( n = 0, i = -1 ; i < argc ; i++ ) {
+		strcpy(buf + n, i < 0 ? cwd : argv[i]);
+		n += strlen(buf + n) + 1;
+	}
+	if ( unix_addr(&sa, path) == -1 )
+		return 2;
+	if ( (sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+			|| connect(sock, (struct sockaddr *) &sa, sizeof(sa)) == -1 ) {
+		perror(path);
+		return 2;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &len;			/* the fds go with it	*/
+	iov.iov_len = sizeof(len);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl;
+	msg.msg_controllen = sizeof(ctl);
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+	if ( sendmsg(sock, &msg, 0) != sizeof(len)
+			|| full_io(sock, buf, len, 1) == -1 ) {
+		perror("smsh: send");
+		return 2;
+	}
+	efree(buf);
+	if ( full_io(sock, (char *) &status, sizeof(status), 0) == -1 ) {
+		fprintf(stderr, "smsh: no status from the server\n");
+		return 2;
+	}
+	close(sock);
+	return status;
+}
@@ -0,0 +1,10 @@
+#ifndef	SERVER_H
+#define	SERVER_H
+/*
+ * header for server.c - smsh --serve and --client
+ */
+
+int	serve(char *);
+int	client(char *, int, char **);
+
+#endif
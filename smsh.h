@@ -1,7 +1,14 @@
 #ifndef	SMSH_H
 #define	SMSH_H
 
+#include	<stddef.h>
+
 /* Put here things that need to be seen by all parts of the program */
 void fatal(char *, char *, int);
+int execute_line(char *, char **);
+int execute_args(char **);
+int run_script(int, char **);
+int run_string(char *, int, char **);
+char **parse_line(char *, size_t);
 
 #endif
@@ -11,6 +11,12 @@
 #include	"varlib.h"
 #include	"process.h"
 #include 	"controlflow.h"
+#include	"function.h"
+#include	"reader.h"
+#include	"wildcard.h"
+#include	"jobs.h"
+#include	"cmdlist.h"
+#include	"server.h"
 
 /**
  **	small-shell version 5
@@ -23,82 +29,223 @@
 
 #define	DFL_PROMPT	"> "
 static char* curr_filename;
-static char* temp_filename;
+static int sourcing = 0;		/* depth of . files */
 
 void	setup();
+static int opens_body(char *, size_t);
 
-void save_last_result(int result) { 
-	char *res = VLlookup("?");
-	asprintf(&res, "%d", result);
-	VLstore("?", res);
-}
-
-int execute_file(FILE *input, char *prompt) 
+int execute_file(struct reader *input, char *prompt) 
 /*
- * Reads data from the input file stream and presents a prompt
+ * Reads lines from the input and presents a prompt
  * if a source (.) is encountered, the function is called 
  * recursively with an empty prompt.
+ * A line is only copied when expanding changes it, otherwise it
+ * is split straight from the reader's buffer or mapping. A script
+ * run from its precompiled form gives most lines already split, and
+ * a then or else block that is not taken is jumped over. A line with
+ * ; && || or & in it is a list, run by cl_run.
+ * Inside an if or case, cf_scan first takes the keywords and the
+ * commands of blocks not taken off the front of the line, so they are
+ * never expanded; a line with nothing left to run costs no allocation.
+ * The last line of a script that is not being sourced is marked with
+ * proc_last, so a program run by it can take the shell's place.
  */
 { 
-	char	*cmdline, **arglist;
-	int		result;
-	FILE *	temp; /* hold a file stream if we source */
-	int curr_line = 1;
-
-	while ( (cmdline = next_cmd(prompt, input)) != NULL ){
-		cmdline = substitute_variables(&cmdline); 
-
-		if ( (arglist = splitline(cmdline)) != NULL  ){
-			/* check for source as first argument */
-			if ( arglist[0] && strcmp(arglist[0], ".") == 0 ) {
-				temp = input;
-				temp_filename = curr_filename;
-				curr_filename = arglist[1];
-				if ( (input = fopen(arglist[1], "r")) == NULL ) {
-					perror("smsh");
-					exit(1);
-				} 
-				result = execute_file(input, ""); /* execute subshell with current env */ 
-				fclose(input);
-				input = temp;
-				curr_filename = temp_filename;
-			} else {
-				result = process(arglist);
+	char	*line, **arglist, **words;
+	size_t	len, skip;
+	int		result = 0;
+	int curr_line = 1, jump, last;
+
+	while ( (line = rd_next(input, prompt, &len)) != NULL ){
+		words = rd_words(input);	/* not ours to free */
+		if ( cf_wants(line, len) && !opens_body(line, len)
+				&& (skip = cf_scan(line, len)) > 0 ) {
+			line += skip;
+			len  -= skip;
+			words = NULL;
+		}
+		last = ( sourcing == 0 && rd_at_end(input)
+						&& !cf_wants(line, len) );
+		if ( len == 0 && words == NULL )
+			result = 0;
+		else if ( words == NULL && cl_find(line, len) ) {
+			proc_last(last);
+			result = cl_run(line, len);
+		}
+		else if ( (arglist = words ? words : parse_line(line, len)) != NULL ){
+			if ( is_function_def(arglist) )	/* reads the body */
+				result = fn_define(arglist, input, &curr_line);
+			else {
+				proc_last(last && arglist[0] != NULL
+						&& strcmp(arglist[0], ".") != 0);
+				result = execute_args(arglist);
+			}
+			if ( arglist != words )
 				freelist(arglist); 
-			} 
 		}
 		curr_line++;
-		free(cmdline);
-		save_last_result(result);
+		VLsetstatus(result);		/* $? is formatted on use */
+		if ( (jump = rd_jump(input)) >= 0 && !ok_to_execute() ) {
+			rd_seek(input, jump);	/* skip the dead block */
+			curr_line = jump + 1;
+		}
+		jobs_reap();			/* if any have ended */
+		if ( sourcing == 0 ) {
+			glob_flush();		/* listings are per line */
+			mem_endline();		/* per-line memory is back */
+		}
 	}
 	check_if_state(curr_filename, curr_line);
 	return result;
 }
 
-int main(int argc, char ** argv)
+int execute_line(char *line, char **words)
+/*
+ * Runs one stored line. words is the line already split when there
+ * was nothing to expand in it, otherwise line is expanded and split
+ * here. line itself is not changed. In an if or case, cf_scan takes
+ * the keywords and commands not to be run off the front first.
+ */
 {
-	FILE *input = stdin;
-	setup();
-	char *prompt = DFL_PROMPT ;
+	char	**arglist;
+	int	result = VLstatus();
+	size_t	skip;
 
-	if (argc > 1) {
-		prompt = "";
-		curr_filename = argv[1];
-		if ( (input = fopen(curr_filename, "r")) == NULL ) {
+	if ( cf_wants(line, strlen(line))
+			&& (skip = cf_scan(line, strlen(line))) > 0 ) {
+		line += skip;		/* keywords and dead commands	*/
+		words = NULL;
+		if ( *line == '\0' )
+			return 0;
+	}
+	if ( words != NULL )
+		return execute_args(words);
+	if ( cl_find(line, strlen(line)) )
+		return cl_run(line, strlen(line));
+
+	if ( (arglist = parse_line(line, strlen(line))) != NULL ) {
+		result = execute_args(arglist);
+		freelist(arglist);
+	}
+	return result;
+}
+
+char **parse_line(char *line, size_t len)
+/*
+ * Expands, splits and globs the first len chars of line
+ * returns the arglist, or NULL for a comment line
+ */
+{
+	char	*cmdline, **arglist;
+
+	if ( (cmdline = substitute_variables(line, len)) != NULL ) {
+		arglist = splitline(cmdline);
+		efree(cmdline);
+	}
+	else
+		arglist = splitline_n(line, len);
+	if ( arglist != NULL )
+		arglist = glob_words(arglist);
+	return arglist;
+}
+
+static int opens_body(char *line, size_t len)
+/*
+ * could the line be a function header? Its body has to be read
+ * past even in a block that is not run, so fn_define must see it
+ */
+{
+	while ( len > 0 && (line[len-1] == ' ' || line[len-1] == '\t') )
+		len--;
+	return len > 0 && line[len-1] == '{';
+}
+
+int execute_args(char **arglist)
+/*
+ * Runs a split command line: sources a file for "." and hands
+ * everything else to process()
+ */
+{
+	struct reader input;
+	char *	temp_filename;
+	int	result;
+
+	/* check for source as first argument */
+	if ( arglist[0] && strcmp(arglist[0], ".") == 0 ) {
+		temp_filename = curr_filename;
+		curr_filename = arglist[1];
+		if ( arglist[1] == NULL || rd_open(&input, arglist[1]) == -1 ) {
 			perror("smsh");
 			exit(1);
-		}
+		} 
+		sourcing++;
+		result = execute_file(&input, ""); /* execute subshell with current env */ 
+		sourcing--;
+		rd_close(&input);
+		curr_filename = temp_filename;
+		return result;
 	}
+	return process(arglist);
+}
 
-	if (argc > 2) {
-		char key[10];
-		for (int i = 2; i < argc; i++) {
-			sprintf(key, "%d", i-1);
-			VLstore(key, argv[i]);
-		}
+int run_script(int argc, char **argv)
+/*
+ * Runs the script argv[0] with argv[1..] as its arguments
+ * returns the status of the last command
+ */
+{
+	struct reader input;
+	int	result;
+
+	curr_filename = argv[0];
+	if ( rd_open(&input, curr_filename) == -1 ) {
+		perror("smsh");
+		exit(1);
 	}
+	VLsetargs(argc, argv);		/* $0 is the script name */
+	result = execute_file(&input, "");
+	rd_close(&input);
+	return result;
+}
+
+int run_string(char *str, int argc, char **argv)
+/*
+ * Runs the lines in str, for smsh -c str [name [args]]; argv[0] is $0
+ * returns the status of the last command
+ */
+{
+	struct reader input;
+	int	result;
+
+	curr_filename = argv[0];
+	rd_string(&input, str);
+	VLsetargs(argc, argv);
+	result = execute_file(&input, "");
+	rd_close(&input);
+	return result;
+}
+
+int main(int argc, char ** argv)
+{
+	struct reader input;
+	int	result;
 
-	return execute_file(input, prompt);
+	if ( argc > 2 && strcmp(argv[1], "--client") == 0 )
+		return client(argv[2], argc - 3, argv + 3);
+	setup();
+	if ( argc > 2 && strcmp(argv[1], "--serve") == 0 )
+		return serve(argv[2]);
+	if ( argc > 2 && strcmp(argv[1], "-c") == 0 )
+		return ( argc > 3 ? run_string(argv[2], argc - 3, argv + 3)
+				  : run_string(argv[2], 1, argv) );
+	if ( argc > 1 )
+		return run_script(argc - 1, argv + 1);
+
+	rd_fromfp(&input, stdin);
+	VLsetargs(1, argv);
+	result = execute_file(&input, DFL_PROMPT);
+	rd_close(&input);
+	return result;
 }
 
 void setup()
@@ -110,11 +257,11 @@ void setup()
 	extern char **environ;
 
 	VLenviron2table(environ);
-	char *pid;
-	asprintf(&pid, "%d", getpid());
-	VLstore("$", pid); 			/* store process id */
+	VLinit();				/* caches the process id */
+	jobs_init();
 	signal(SIGINT,  SIG_IGN);
 	signal(SIGQUIT, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);		/* print gets EPIPE	*/
 }
 
 void fatal(char *s1, char *s2, int n)
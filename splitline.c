@@ -2,6 +2,7 @@
  *    
  *    char *next_cmd(char *prompt, FILE *fp) - get next command
  *    char **splitline(char *str);           - parse a string
+ *    char **splitline_n(char *str, size_t n) - parse n chars of a string
  */
 
 #include	<stdio.h>
@@ -10,6 +11,7 @@
 #include	"splitline.h"
 #include	"smsh.h"
 #include	"flexstr.h"
+#include	"scan.h"
 
 char * next_cmd(char *prompt, FILE *fp)
 /*
@@ -18,11 +20,13 @@ char * next_cmd(char *prompt, FILE *fp)
  *  errors: NULL at EOF (not really an error)
  *          calls fatal from emalloc()
  *   notes: allocates space in BUFSIZ chunks.  
+ *          caller frees the string with efree()
  */
 {
 	int	c;				/* input char		*/
 	FLEXSTR	s;				/* the command		*/
 	int	pos = 0;
+	int	tag = mem_tag(MT_READER);
 
 	fs_init(&s, 0);				/* initialize the str	*/
 	printf("%s", prompt);				/* prompt user	*/
@@ -36,9 +40,13 @@ char * next_cmd(char *prompt, FILE *fp)
 		fs_addch(&s, c);
 		pos++;
 	}
-	if ( c == EOF && pos == 0 )		/* EOF and no input	*/
+	if ( c == EOF && pos == 0 ) {		/* EOF and no input	*/
+		fs_free(&s);
+		mem_tag(tag);
 		return NULL;			/* say so		*/
+	}
 	fs_addch(&s, '\0');			/* terminate string	*/
+	mem_tag(tag);
 	return fs_getstr(&s);
 }
 
@@ -57,39 +65,54 @@ char ** splitline(char *line)
  *  action: traverse the array, locate strings, make copies
  *    note: strtok() could work, but we may want to add quotes later
  */
+{
+	if ( line == NULL )
+		return NULL;
+	return splitline_n(line, strlen(line));
+}
+
+char ** splitline_n(char *line, size_t n)
+/*
+ * purpose: splitline for the first n chars of line, which need not
+ *          be nul-terminated (a line served straight from a script)
+ * returns: same as splitline
+ */
 {
 	char	*newstr();
-	int	start;
+	size_t	start;
 	int	len;
-	int	i=0;
+	size_t	i=0;
 	FLEXLIST strings;
+	int	tag;
 
-	if ( line == NULL || line[0] == '#' )	/* handle special cases */
+	if ( n > 0 && line[0] == '#' )		/* handle special cases */
 		return NULL;
 
+	tag = mem_tag(MT_TOKEN);
 	fl_init(&strings,0);
 
-	while( line[i] != '\0' )
+	while( i < n )
 	{
-		while ( is_delim(line[i]) )	{/* skip leading spaces	*/
+		while ( i < n && is_delim(line[i]) )	{/* skip leading spaces	*/
 			i++;
-			if (line[i] == '#') {	/* we're done if we encounter a comment */
+			if (i < n && line[i] == '#') {	/* we're done if we encounter a comment */
 				fl_append(&strings, NULL);
+				mem_tag(tag);
 				return fl_getlist(&strings);
 			}
 		}
 
-		if ( line[i] == '\0' )		/* end of string? 	*/
+		if ( i == n )			/* end of string? 	*/
 			break;			/* yes, get out		*/
 
 		/* mark start, then find end of word */
-		start = i++;
-		len   = 1;
-		while ( line[i] != '\0' && !(is_delim(line[i])) )
-			i++, len++;
+		start = i;
+		len   = scan_any(line + i, n - i, " \t");
+		i    += len;
 		fl_append(&strings, newstr(&line[start], len));
 	}
 	fl_append(&strings, NULL);
+	mem_tag(tag);
 	return fl_getlist(&strings);
 }
 
@@ -102,7 +125,7 @@ char *newstr(char *s, int l)
 	char *rv = emalloc(l+1);
 
 	rv[l] = '\0';
-	strncpy(rv, s, l);
+	memcpy(rv, s, l);
 	return rv;
 }
 
@@ -116,22 +139,6 @@ freelist(char **list)
 {
 	char	**cp = list;
 	while( *cp != NULL )
-		free(*cp++);
-	free(list);
+		efree(*cp++);
+	efree(list);
 }
-
-void * emalloc(size_t n)
-{
-	void *rv ;
-	if ( (rv = malloc(n)) == NULL )
-		fatal("out of memory","",1);
-	return rv;
-}
-void * erealloc(void *p, size_t n)
-{
-	void *rv;
-	if ( (rv = realloc(p,n)) == NULL )
-		fatal("realloc() failed","",1);
-	return rv;
-}
-
@@ -4,10 +4,13 @@
 #define	YES	1
 #define	NO	0
 
+#include	<stddef.h>
+#include	"memstat.h"
+
 char	*next_cmd();
 char	**splitline(char *);
+char	**splitline_n(char *, size_t);
 void	freelist(char **);
-void	*emalloc(size_t);
-void	*erealloc(void *, size_t);
+char	*newstr(char *, int);
 
 #endif
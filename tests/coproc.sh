@@ -0,0 +1,26 @@
+coproc C cat
+print -u ${C[1]} hello
+read -u ${C[0]} line
+echo got $line
+coproc D true
+wait ${D_PID}
+print -u ${D[1]} x
+echo print to a dead coproc: $?
+echo still alive
+f() {
+read x
+print got $x
+read y
+print then $?
+}
+coproc E cat
+coproc F f
+print -u ${F[1]} one
+read -u ${F[0]} r
+echo $r
+coproc -c F
+read -u ${F[0]} r
+echo $r
+coproc -c E
+wait ${E_PID}
+echo cat saw its end of input: $?
@@ -5,13 +5,37 @@
  *
  * interface:
  *     VLstore( name, value )    returns 0 for 0k, 1 for no
+ *     VLappend( name, value )   name+=value, same returns
  *     VLlookup( name )          returns string or NULL if not there
+ *     VLisset( name )           true if name is there, even if empty
  *     VLlist()			 prints out current table
  *
  * environment-related functions
  *     VLexport( name )		 adds name to list of env vars
  *     VLtable2environ()	 copy from table to environ
- *     VLenviron2table()         copy from environ to table
+ *     VLenviron2table()         import environ into the table
+ *
+ * special parameters ($?, $$, $!, $#, $@, $0..$9)
+ *     VLsetstatus( n )          record exit status of last command
+ *     VLsetbgpid( pid )         record the pid of the last job, for $!
+ *     VLstatus()                returns exit status of last command
+ *     VLsetargs( argc, argv )   set $0 and the positional parameters
+ *     VLshift( n )              drop the first n positional parameters
+ *     VLgetargs( &argc, &argv ) fetch the current positional parameters
+ *
+ * indexed arrays
+ *     VLsetelem( name, i, value )  set name[i], making name an array
+ *     VLsetarray( name, v, n, block, size )  make name the array v[0..n-1]
+ *
+ * integer variables (declare -i)
+ *     VLsetint( name, on )      give name the integer attribute or take it
+ *     VLgetint( name, len, &v ) the value of a variable as a number
+ *
+ * function scopes
+ *     VLpushscope()             enter a function call
+ *     VLlocal( name, value )    make name local to the current call,
+ *                               keeping its value if value is NULL
+ *     VLpopscope()              leave a call, restoring saved values
  *
  * details:
  *	the table is stored as an array of structs that
@@ -20,78 +44,391 @@
  *	environment.  It makes searching pretty easy, as
  *	long as you search for "name=" 
  *
+ *	the environment is not copied at startup. VLenviron2table only
+ *	remembers environ; the first lookup then enters those strings in
+ *	the table in place, and builds a hash index on the names. A string
+ *	is only malloced when a variable is given a new value, so a short
+ *	run that touches a few variables copies almost nothing. As long
+ *	as no exported variable changes, VLtable2environ hands back the
+ *	inherited environ as it is.
+ *
+ *	${...} takes the operators of sh and bash after the parameter:
+ *	defaults, substrings, prefix and suffix strips, replacement and
+ *	case changes. They are done in the expansion pass and write into
+ *	the output line; patterns without wildcards are matched with memcmp.
+ *
+ *	special and positional parameters are not kept in the table.
+ *	they live in dedicated fields below and are only turned into
+ *	strings when a command line actually expands them.
+ *
+ *	an array is a variable whose item points at a struct array, a
+ *	vector of value strings indexed by subscript; its name=val string
+ *	is just "name=". Elements past the end that were never set are
+ *	NULL. mapfile loads a whole file as one block with the lines in
+ *	it, so the elements that point into that block are not malloced
+ *	one by one; an element that is given a new value gets its own
+ *	string. ${a[@]} and ${a[i]} read the vector directly.
+ *
+ *	an integer variable keeps its value as an int64 in ival. What is
+ *	assigned to it is evaluated by arith_eval, and a name in there
+ *	that is an integer variable gives its ival, so n=n+1 is done with
+ *	no string at all. The name=val string is made once, with room for
+ *	any number, and the digits are only written into it when the value
+ *	is read as a string and a write has made them stale.
+ *
  * hist: 2015-05-14 VLstore now handles NULL cases safely (10q mk)
  */
 
+#define	_GNU_SOURCE
 #include	<stdio.h>
 #include	<stdlib.h>
 #include	<string.h>
 #include 	<ctype.h>
 #include	<regex.h>
+#include	<unistd.h>
+#include	<stdint.h>
+#include	<inttypes.h>
 
+#include	"smsh.h"
 #include	"varlib.h"
 #include	"splitline.h"
+#include	"flexstr.h"
 #include	"builtin.h"
+#include	"arith.h"
+#include	"match.h"
+#include	"scan.h"
+
+#define	INTBUF	21			/* -9223372036854775808	*/
 
-#define	MAXVARS	200		/* a linked list would be nicer */
+struct array {
+		char	**v;		/* the values, NULL if unset */
+		int	n;		/* highest index + 1	*/
+		int	max;		/* slots in v		*/
+		int	nset;		/* non-NULL elements	*/
+		char	*block;		/* lines from mapfile	*/
+		size_t	blen;
+	};
 
 struct var {
 		char *str;		/* name=val string	*/
 		int  global;		/* a boolean		*/
+		int  owned;		/* str malloced by us	*/
+		int  next;		/* hash chain, -1 ends	*/
+		struct array *arr;	/* NULL for a scalar	*/
+		int  isint;		/* declare -i		*/
+		int  stale;		/* str behind ival	*/
+		int64_t ival;		/* value if isint	*/
+		size_t len;		/* strlen(str), unless isint */
+		size_t cap;		/* bytes at str, 0 if not owned */
 	};
 
-static struct var tab[MAXVARS];			/* the table	*/
+static struct var *tab = NULL;			/* the table	*/
+static int	nvars = 0, maxvars = 0;
+static int	*buckets = NULL;		/* index on names */
+static int	nbuckets = 0;
+static char	**env_src = NULL;		/* not yet loaded */
+static char	**env_orig = NULL;		/* as inherited	*/
+static int	env_dirty = 0;			/* env changed?	*/
+
+static int	last_status = 0;		/* $?		*/
+static int	bg_pid = 0;			/* $!, 0 if none */
+static char	pid_str[24];			/* $$, set once	*/
+static char	**posv = NULL;			/* $0, $1, ...	*/
+static int	posc = 0;			/* count incl $0 */
+
+/*
+ * the scope stack: `local' moves the caller's name=val string out
+ * of the table and onto this stack, VLpopscope puts it back.
+ * str == NULL means the name did not exist before the call.
+ */
+struct saved {
+		char *name;		/* copy of the name	*/
+		char *str;		/* caller's name=val	*/
+		int  global;		/* caller's flag	*/
+		int  owned;		/* caller's flag	*/
+		struct array *arr;	/* caller's array	*/
+		int  isint;		/* caller's attribute	*/
+		int64_t ival;
+		int  depth;		/* scope it belongs to	*/
+	};
+
+static struct saved *saves = NULL;
+static int	nsaves = 0, maxsaves = 0;
+static int	scope_depth = 0;
 
 static char *new_string( char *, char *);	/* private methods	*/
 static struct var *find_item(char *, int);
+static void drop_item(struct var *);
+static struct var *add_item(char *, int, int);
+static void set_str(struct var *, char *, int);
+static void load_env();
 
-static char *escape_char(char **, char*);
-static char *substitute(char **, char*);
+static struct var *find_item_n(char *, int);
+static void expand(FLEXSTR *, char *, char *);
+static char *escape_char(FLEXSTR *, char *, char *);
+static char *substitute(FLEXSTR *, char *, char *);
+static char *braced(FLEXSTR *, char *, char *);
+static int braced_value(FLEXSTR *, char *, char *, int);
+static void special_value(FLEXSTR *, char *);
+static void free_array(struct array *);
+static int name_len(char *);
+static char *scalar_value(struct var *);
+static void fresh(struct var *);
+static int set_int(struct var *, char *);
+static int fits(struct var *, char *, int);
 
 void VLinit()
 /*
  * initialize variable storage system
+ * the pid never changes so it is formatted once here
+ */
+{
+	snprintf(pid_str, sizeof(pid_str), "%d", (int) getpid());
+}
+
+void VLsetstatus(int status)
+/*
+ * record the exit status of the last command. no formatting here,
+ * $? is turned into a string only when it is expanded
+ */
+{
+	last_status = status;
+}
+
+int VLstatus()
+{
+	return last_status;
+}
+
+void VLsetbgpid(int pid)
+{
+	bg_pid = pid;
+}
+
+void VLsetargs(int argc, char **argv)
+/*
+ * set $0 and the positional parameters from argv[0..argc-1]
+ * the strings are not copied, caller keeps them alive
+ */
+{
+	posv = argv;
+	posc = argc;
+}
+
+int VLshift(int n)
+/*
+ * drop the first n positional parameters ($0 stays put)
+ * returns 0 for ok, 1 if there are fewer than n of them
+ */
+{
+	if ( n < 0 || n > posc - 1 )
+		return 1;
+	if ( n > 0 ) {
+		posv[n] = posv[0];	/* keep $0 in front of the rest	*/
+		posv += n;
+		posc -= n;
+	}
+	return 0;
+}
+
+void VLgetargs(int *argcp, char ***argvp)
+{
+	*argcp = posc;
+	*argvp = posv;
+}
+
+void VLpushscope()
+/*
+ * start a new scope for a function call
+ */
+{
+	scope_depth++;
+}
+
+int VLlocal(char *name, char *val)
+/*
+ * make name local to the innermost scope and give it val. With val
+ * NULL a name already local there is left as it is, and a new local
+ * starts with the value name has now.
+ * returns 0 for ok, 1 if not inside a function call
+ */
+{
+	struct var *itemp;
+	int	i, tag;
+
+	if ( scope_depth == 0 )
+		return 1;
+	for ( i = nsaves - 1 ; i >= 0 && saves[i].depth == scope_depth ; i-- )
+		if ( strcmp(saves[i].name, name) == 0 )	/* already local */
+			return ( val != NULL ? VLstore(name, val) : 0 );
+	if ( val == NULL && (val = VLlookup(name)) == NULL )
+		val = "";
+
+	tag = mem_tag(MT_VARLIB);
+	if ( nsaves == maxsaves ) {
+		maxsaves = maxsaves ? 2 * maxsaves : 16;
+		saves = erealloc(saves, maxsaves * sizeof(struct saved));
+	}
+	saves[nsaves].name  = strcpy(emalloc(strlen(name)+1), name);
+	mem_tag(tag);
+	saves[nsaves].depth = scope_depth;
+	saves[nsaves].str   = NULL;
+	saves[nsaves].global = 0;
+	saves[nsaves].owned = 0;
+	saves[nsaves].arr   = NULL;
+	saves[nsaves].isint = 0;
+	if ( (itemp = find_item(name, 0)) != NULL ) {
+		fresh(itemp);
+		saves[nsaves].str    = itemp->str;	/* hand it over	*/
+		saves[nsaves].global = itemp->global;
+		saves[nsaves].owned  = itemp->owned;
+		saves[nsaves].arr    = itemp->arr;
+		saves[nsaves].isint  = itemp->isint;
+		saves[nsaves].ival   = itemp->ival;
+		itemp->owned = 0;			/* so not freed	*/
+		itemp->arr   = NULL;
+		set_str(itemp, new_string(name, val), 1);
+		nsaves++;
+		return 0;
+	}
+	nsaves++;
+	return VLstore(name, val);
+}
+
+void VLpopscope()
+/*
+ * leave a function call: put back everything made local in it
+ */
+{
+	struct var *itemp;
+	struct saved *sp;
+
+	while ( nsaves > 0 && saves[nsaves-1].depth == scope_depth ) {
+		sp = &saves[--nsaves];
+		itemp = find_item(sp->name, 0);
+		if ( sp->str == NULL ) {		/* was not set before */
+			if ( itemp != NULL )
+				drop_item(itemp);
+		}
+		else {
+			if ( itemp != NULL ) {
+				set_str(itemp, sp->str, sp->owned);
+				itemp->global = sp->global;
+				free_array(itemp->arr);
+			}
+			else
+				itemp = add_item(sp->str, sp->global, sp->owned);
+			itemp->arr   = sp->arr;
+			itemp->isint = sp->isint;
+			itemp->ival  = sp->ival;
+		}
+		efree(sp->name);
+	}
+	if ( scope_depth > 0 )
+		scope_depth--;
+}
+
+static void special_value(FLEXSTR *out, char *name)
+/*
+ * appends the value of a special parameter to out: name is one
+ * of ?, $, !, #, @ or a single digit
+ */
+{
+	char	numbuf[24];
+	int	i;
+
+	switch ( *name ) {
+		case '?':
+			snprintf(numbuf, sizeof(numbuf), "%d", last_status);
+			fs_addstr(out, numbuf);
+			return;
+		case '$':
+			fs_addstr(out, pid_str);
+			return;
+		case '!':
+			if ( bg_pid != 0 ) {
+				snprintf(numbuf, sizeof(numbuf), "%d", bg_pid);
+				fs_addstr(out, numbuf);
+			}
+			return;
+		case '#':
+			snprintf(numbuf, sizeof(numbuf), "%d",
+					posc > 0 ? posc - 1 : 0);
+			fs_addstr(out, numbuf);
+			return;
+		case '@':
+			for ( i = 1 ; i < posc ; i++ ) {
+				if ( i > 1 )
+					fs_addch(out, ' ');
+				fs_addstr(out, posv[i]);
+			}
+			return;
+	}
+	i = *name - '0';			/* a digit	*/
+	if ( i < posc )
+		fs_addstr(out, posv[i]);
+}
+
+char *substitute_variables(char *line, size_t len)
+/*
+ * Expands the first len chars of line: $names are replaced by their
+ * values and \x becomes x. The expanded line is built in one pass.
+ * returns: a new malloced string, or NULL if there was nothing to
+ *          expand, so the caller can go on using line as it is
  */
 {
+	char	*end = line + len;
+	FLEXSTR	out;
+	int	tag;
+
+	if ( scan_any(line, len, "$\\") == len )
+		return NULL;
+
+	tag = mem_tag(MT_EXPAND);
+	fs_init(&out, len + 64);
+	expand(&out, line, end);
+	mem_tag(tag);
+	return fs_getstr(&out);
 }
 
-char *substitute_variables(char **cmdline)
+static void expand(FLEXSTR *out, char *line, char *end)
 /*
- * Iterates through the string looking for words prefixed with $. 
- * Will call substitute if it finds the word unless it's $ is escaped.
- * 
+ * appends the expansion of line..end to out
  */
 {
-	char *substr = *cmdline;
+	size_t	n;
+
 	/* mini parser which could be extended for more advance shell */
-	while ( *substr != '\0' ) {
-		switch ( *substr ) {
+	while ( line < end ) {
+		switch ( *line ) {
 			case '\\':
-				substr = escape_char(cmdline, substr);
+				line = escape_char(out, line, end);
 				break;
 			case '$':
-				substr = substitute(cmdline, substr);
+				line = substitute(out, line, end);
 				break;
+			default:		/* copy up to the next one */
+				n = scan_any(line, end - line, "$\\");
+				fs_addmem(out, line, n);
+				line += n;
 		}
-		substr++;
 	}
-	return *cmdline;
 }
 
-char *escape_char(char **cmdline, char *substr)
+static char *escape_char(FLEXSTR *out, char *substr, char *end)
 /*
- * Escapes a character by nulling out the \ and then concating the orignal
- * string (cmdline) with the esacped string.
+ * Escapes a character: the \ is dropped and the char after it is
+ * copied as is. For the wildcard chars and \ itself the \ is kept so
+ * pathname expansion knows not to touch them; it removes it later.
+ * returns pointer past the escaped char
  */
 {
-	char * new_string = emalloc(sizeof(char) * strlen(*cmdline));
-	*substr = '\0';
-
-	int len = strlen(*cmdline);
-	sprintf(new_string, "%s%s", *cmdline, (substr + 1));
-
-	*cmdline = new_string; 
-	return new_string + len;		/*return pointer to the new string*/
+	if ( ++substr < end ) {
+		if ( strchr("*?[\\", *substr) != NULL )
+			fs_addch(out, '\\');
+		fs_addch(out, *substr++);
+	}
+	return substr;
 }
 
 int is_valid_bash_variable(char *ptr) 
@@ -107,72 +444,913 @@ int is_bash_special_char(char *ptr)
   *  that need to be supported as well. 
   */
 {
-	return isdigit(*ptr) || *ptr == '$' || *ptr == '\?';
+	return isdigit(*ptr) || *ptr == '$' || *ptr == '\?' || *ptr == '!' ||
+		*ptr == '#' || *ptr == '@';
 }
 
-char *substitute(char **cmdline, char *substr)
+static char *substitute(FLEXSTR *out, char *substr, char *end)
 /*
- * substitute bookends the substr variable with \0 chars
- * sets the ptr value to be the first chat after the $
- * 
- * iterates through the substr until it finds an invalid variable char
- * and sets the value to \0
+ * substr points at a $. Finds the name after it and appends its
+ * value to out. A $ with no name after it is copied as is.
+ * returns pointer to the first char after the name
  */
 {
-	char temp, *lookup_value, *new_string, *ptr = substr + 1; 
-
-	*substr = '\0';
-	int len = strlen(*cmdline);
+	char *ptr = substr + 1; 
+	struct var *itemp;
 
-	if ( is_bash_special_char(ptr) && ptr == substr+1 ) { // found $1, $2 etc
+	if ( ptr < end && *ptr == '{' )
+		return braced(out, ptr, end);
+	if ( ptr < end && is_bash_special_char(ptr) ) { // found $1, $2 etc
+		special_value(out, ptr);
+		return ptr + 1;
+	}
+	while( ptr < end && is_valid_bash_variable(ptr) )
 		ptr++;
+
+	if ( ptr == substr + 1 )
+		fs_addch(out, '$');          /* bash will echo a $ if it's standalone */
+	else if ( (itemp = find_item_n(substr + 1, ptr - substr - 1)) != NULL )
+		fs_addstr(out, scalar_value(itemp));
+	return ptr;
+}
+
+static char *expand_str(char *p, char *end)
+/*
+ * returns a new string with the expansion of p..end
+ */
+{
+	FLEXSTR	s;
+
+	fs_init(&s, end - p + 16);
+	expand(&s, p, end);
+	return fs_getstr(&s);
+}
+
+static char *subscript(char *p, char *end, int *idxp)
+/*
+ * expands the subscript p..end and converts it to a number
+ * returns NULL if it is not one, else p
+ */
+{
+	char	*s, *cp;
+	long	n;
+
+	s = expand_str(p, end);
+	n = strtol(s, &cp, 10);
+	if ( cp == s || *cp != '\0' )
+		p = NULL;
+	efree(s);
+	*idxp = (int) n;
+	return p;
+}
+
+static char *elem(struct array *ap, int i)
+/*
+ * element i of an array, negative i counts from the end
+ * returns NULL if that element is not set
+ */
+{
+	if ( i < 0 )
+		i += ap->n;
+	if ( i < 0 || i >= ap->n )
+		return NULL;
+	return ap->v[i];
+}
+
+static char *scalar_value(struct var *itemp)
+/*
+ * the value of $name: for an array that is element 0
+ */
+{
+	char	*s;
+
+	if ( itemp->arr == NULL ) {
+		fresh(itemp);
+		return itemp->str + name_len(itemp->str) + 1;
+	}
+	s = elem(itemp->arr, 0);
+	return ( s ? s : "" );
+}
+
+static char *braced(FLEXSTR *out, char *p, char *end)
+/*
+ * p points at the { of ${...}. Finds the matching } and appends
+ * the value of what is between them.
+ * returns pointer past the }
+ */
+{
+	char	*close, *name;
+	int	depth = 0, count = 0;
+
+	for ( close = p ; close < end ; close++ )
+		if ( *close == '\\' && close + 1 < end )
+			close++;
+		else if ( *close == '{' )
+			depth++;
+		else if ( *close == '}' && --depth == 0 )
+			break;
+	if ( close == end ) {			/* no } : copy as is	*/
+		fs_addch(out, '$');
+		return p;
+	}
+	name = p + 1;
+	if ( *name == '#' && name + 1 < close ) {
+		count = 1;
+		name++;
+	}
+	if ( braced_value(out, name, close, count) != 0 )
+		fprintf(stderr, "smsh: ${%.*s}: bad substitution\n",
+				(int)(close - p - 1), p + 1);
+	return close + 1;
+}
+
+static void put_value(FLEXSTR *out, char *val, int count)
+/*
+ * appends val, or its length for ${#...}
+ */
+{
+	char	numbuf[24];
+
+	if ( val == NULL )
+		val = "";
+	if ( count ) {
+		snprintf(numbuf, sizeof(numbuf), "%d", (int) strlen(val));
+		fs_addstr(out, numbuf);
+	}
+	else
+		fs_addstr(out, val);
+}
+
+static void put_n(FLEXSTR *out, char *s, size_t n)
+{
+	while ( n-- > 0 )
+		fs_addch(out, *s++);
+}
+
+/*
+ * the pattern of ${v#p} ${v%p} ${v/p/r} and ${v^p}, expanded. One
+ * with no wildcards has its \ taken out and is compared with memcmp.
+ */
+struct pattern {
+		char	*text;
+		size_t	len;
+		int	glob;		/* has * ? or [...]	*/
+	};
+
+static void get_pattern(struct pattern *pp, char *p, char *end)
+{
+	char	*s, *d;
+
+	pp->text = expand_str(p, end);
+	if ( (pp->glob = has_wildcards(pp->text)) == 0 ) {
+		for ( s = d = pp->text ; *s != '\0' ; *d++ = *s++ )
+			if ( *s == '\\' && s[1] != '\0' )
+				s++;
+		*d = '\0';
+	}
+	pp->len = strlen(pp->text);
+}
+
+static int pat_match(struct pattern *pp, char *s, size_t n)
+/*
+ * do the n chars at s match the pattern? The string is ended at n for
+ * pmatch and then put back; nothing is copied.
+ */
+{
+	char	c;
+	int	rv;
+
+	if ( !pp->glob )
+		return n == pp->len && memcmp(s, pp->text, n) == 0;
+	if ( (c = s[n]) != '\0' )
+		s[n] = '\0';
+	rv = pmatch(pp->text, s);
+	if ( c != '\0' )
+		s[n] = c;
+	return rv;
+}
+
+static size_t longest_at(struct pattern *pp, char *s, size_t n)
+/*
+ * the length of the longest match at the front of the n chars at s,
+ * 0 if there is none
+ */
+{
+	size_t	k;
+
+	if ( !pp->glob )
+		return pat_match(pp, s, pp->len <= n ? pp->len : n) ? pp->len : 0;
+	for ( k = n ; k > 0 ; k-- )
+		if ( pat_match(pp, s, k) )
+			return k;
+	return 0;
+}
+
+static void strip(FLEXSTR *out, char *val, char *op, char *close)
+/*
+ * ${v#p} ${v##p} ${v%p} ${v%%p}: val less the shortest or longest
+ * prefix or suffix matching p
+ */
+{
+	struct pattern pt;
+	size_t	n = strlen(val), len, j, k = 0;
+	int	back = ( *op == '%' ), longest = ( op[1] == *op );
+
+	get_pattern(&pt, op + 1 + longest, close);
+	if ( !pt.glob ) {
+		if ( pt.len <= n && pat_match(&pt, back ? val + n - pt.len : val,
+								pt.len) )
+			k = pt.len;
+	}
+	else
+		for ( j = 0 ; j <= n ; j++ ) {
+			len = longest ? n - j : j;
+			if ( pat_match(&pt, back ? val + n - len : val, len) ) {
+				k = len;
+				break;
+			}
+		}
+	efree(pt.text);
+	if ( back )
+		put_n(out, val, n - k);
+	else
+		fs_addstr(out, val + k);
+}
+
+static void replace(FLEXSTR *out, char *val, char *p, char *close)
+/*
+ * ${v/p/r}: the first longest match of p is made r. ${v//p/r} does
+ * every one, ${v/#p/r} only one at the front, ${v/%p/r} at the end.
+ * A literal p is found with memmem.
+ */
+{
+	struct pattern pt;
+	char	*q, *rep, *hit, mode = 0;
+	size_t	n = strlen(val), i, from, k;
+	int	depth = 0;
+
+	if ( *p == '/' || *p == '#' || *p == '%' )
+		mode = *p++;
+	for ( q = p ; q < close && (*q != '/' || depth > 0) ; q++ )
+		if ( *q == '\\' && q + 1 < close )
+			q++;
+		else if ( *q == '{' )
+			depth++;
+		else if ( *q == '}' )
+			depth--;
+	get_pattern(&pt, p, q);
+	rep = ( q < close ? expand_str(q + 1, close) : NULL );
+	if ( mode == '%' ) {			/* a match up to the end */
+		for ( i = 0 ; i <= n && !pat_match(&pt, val + i, n - i) ; i++ )
+			;
+		put_n(out, val, i);
+		if ( i <= n && rep != NULL )
+			fs_addstr(out, rep);
+	}
+	else if ( pt.len == 0 ) {		/* only /# adds to it	*/
+		if ( mode == '#' && rep != NULL )
+			fs_addstr(out, rep);
+		fs_addstr(out, val);
 	}
 	else {
-		while( *ptr != '\0' &&  is_valid_bash_variable(ptr) ){
-			ptr++;
-		} 
-	} 
+		for ( i = from = 0 ; i < n ; ) {
+			if ( !pt.glob && mode != '#' ) {
+				hit = memmem(val + i, n - i, pt.text, pt.len);
+				if ( hit == NULL )
+					break;
+				i = hit - val;
+			}
+			if ( (k = longest_at(&pt, val + i, n - i)) == 0 ) {
+				if ( mode == '#' )
+					break;
+				i++;
+				continue;
+			}
+			put_n(out, val + from, i - from);
+			if ( rep != NULL )
+				fs_addstr(out, rep);
+			from = i += k;
+			if ( mode != '/' )
+				break;
+		}
+		fs_addstr(out, val + from);
+	}
+	efree(pt.text);
+	efree(rep);
+}
+
+static void change_case(FLEXSTR *out, char *val, char *op, char *close)
+/*
+ * ${v^} ${v^^} ${v,} ${v,,}: the first or every char to upper or
+ * lower case; with a pattern after it only the chars that match it
+ */
+{
+	struct pattern pt;
+	char	c[2] = { 0, 0 };
+	int	all = ( op[1] == *op ), i;
+
+	get_pattern(&pt, op + 1 + all, close);
+	for ( i = 0 ; val[i] != '\0' ; i++ ) {
+		c[0] = val[i];
+		if ( (i == 0 || all) && (pt.len == 0 || pat_match(&pt, c, 1)) )
+			c[0] = *op == '^' ? toupper((unsigned char) c[0])
+					 : tolower((unsigned char) c[0]);
+		fs_addch(out, c[0]);
+	}
+	efree(pt.text);
+}
+
+static int offsets(char *p, char *close, int n, int *offp, int *lenp)
+/*
+ * the off or off:len of ${v:off:len} as numbers for a value of n chars
+ * or elements: off counts back from the end if it is negative, and so
+ * does a negative len, as an end. off past the end gives *lenp 0.
+ * returns 0 for ok, 1 for a bad expression or an end before off
+ */
+{
+	char	*q, *s;
+	int64_t	off, len = n;
+	int	depth = 0, rv;
+
+	for ( q = p ; q < close && (*q != ':' || depth > 0) ; q++ )
+		if ( *q == '{' )
+			depth++;
+		else if ( *q == '}' )
+			depth--;
+	s = expand_str(p, q);
+	rv = arith_eval(s, &off);
+	efree(s);
+	if ( rv == 0 && q < close ) {
+		s = expand_str(q + 1, close);
+		rv = arith_eval(s, &len);
+		efree(s);
+	}
+	if ( rv != 0 )
+		return 1;
+	if ( off < 0 )
+		off += n;
+	if ( off < 0 || off > n )
+		off = n, len = 0;
+	if ( len < 0 && (len += n - off) < 0 )
+		return 1;
+	if ( len > n - off )
+		len = n - off;
+	*offp = (int) off;
+	*lenp = (int) len;
+	return 0;
+}
+
+static int slice(FLEXSTR *out, char **v, int n, char *p, char *close)
+/*
+ * ${a[@]:off:len} and ${@:off:len}: len set elements from index off
+ */
+{
+	int	off, len, i, sep = 0;
+
+	if ( offsets(p, close, n, &off, &len) != 0 )
+		return 1;
+	for ( i = off ; i < n && len > 0 ; i++ )
+		if ( v[i] != NULL ) {
+			if ( sep++ )
+				fs_addch(out, ' ');
+			fs_addstr(out, v[i]);
+			len--;
+		}
+	return 0;
+}
 
-	temp = *ptr;
-	*ptr = '\0';
+static int is_default_op(char *op, char *close)
+/*
+ * is op one of - = + ? with or without the : before it?
+ */
+{
+	if ( *op == ':' && op + 1 < close )
+		op++;
+	return strchr("-=+?", *op) != NULL;
+}
 
-	lookup_value = VLlookup(substr + 1); // substr should now be \0VAR\0rest
+static int operate(FLEXSTR *out, char *val, int set, char *op, char *close,
+						char *name, int nlen)
+/*
+ * purpose: append val as the operator at op..close makes it
+ *    args: set is 0 if there is no such parameter, then val is "".
+ *          name is what ${name:=w} assigns to, NULL if it can't be.
+ * returns: 0 for ok, 1 for a bad substitution
+ *    note: words are expanded only if they are used; a default goes
+ *          straight into out
+ */
+{
+	char	*word, *s;
+	int	off, len, empty, rv = 0;
+
+	if ( op == close ) {
+		fs_addstr(out, val);
+		return 0;
+	}
+	if ( is_default_op(op, close) ) {
+		empty = !set || (*op == ':' && *val == '\0');
+		if ( *op == ':' )
+			op++;
+		if ( *op == '+' ? empty : !empty ) {
+			if ( *op != '+' )
+				fs_addstr(out, val);
+			return 0;
+		}
+		if ( *op == '-' || *op == '+' ) {
+			expand(out, op + 1, close);
+			return 0;
+		}
+		word = expand_str(op + 1, close);
+		if ( *op == '?' )
+			fprintf(stderr, "smsh: %.*s: %s\n", nlen, name, *word ? word
+					: "parameter null or not set");
+		else if ( name == NULL )
+			rv = 1;
+		else {
+			s = newstr(name, nlen);
+			VLstore(s, word);
+			efree(s);
+			fs_addstr(out, word);
+		}
+		efree(word);
+		return rv;
+	}
+	switch ( *op ) {
+	case ':':
+		if ( offsets(op + 1, close, strlen(val), &off, &len) != 0 )
+			return 1;
+		put_n(out, val + off, len);
+		return 0;
+	case '#':
+	case '%':
+		strip(out, val, op, close);
+		return 0;
+	case '/':
+		replace(out, val, op + 1, close);
+		return 0;
+	case '^':
+	case ',':
+		change_case(out, val, op, close);
+		return 0;
+	}
+	return 1;
+}
+
+static int each(FLEXSTR *out, char **v, int n, char *op, char *close)
+/*
+ * ${a[@]op} and ${@op}: a pattern or case operator is done on each
+ * element; a default looks at them all joined
+ */
+{
+	FLEXSTR	all;
+	char	*s;
+	int	i, sep = 0, nset = 0, rv = 0;
 
-	if (*(substr + 1) == '\0' && *lookup_value == '\0')
-		lookup_value = "$";          /* bash will echo a $ if it's standalone */
-	*ptr = temp;
+	if ( op != close && is_default_op(op, close) ) {
+		fs_init(&all, 64);
+		for ( i = 0 ; i < n ; i++ )
+			if ( v[i] != NULL ) {
+				if ( nset++ )
+					fs_addch(&all, ' ');
+				fs_addstr(&all, v[i]);
+			}
+		s = fs_getstr(&all);
+		rv = operate(out, s, nset > 0, op, close, NULL, 0);
+		efree(s);
+		return rv;
+	}
+	for ( i = 0 ; i < n && rv == 0 ; i++ )
+		if ( v[i] != NULL ) {
+			if ( sep++ )
+				fs_addch(out, ' ');
+			rv = operate(out, v[i], 1, op, close, NULL, 0);
+		}
+	return rv;
+}
 
-	new_string = (char*)emalloc(   /* using emalloc to protect against large variable values */
-		sizeof(char) * (len + strlen(ptr) + strlen(lookup_value) + 1)
-	);
+static int braced_value(FLEXSTR *out, char *name, char *close, int count)
+/*
+ * the inside of ${...} without the # of ${#...}: name, a number for
+ * a positional parameter, a special parameter, name[i], name[@] or
+ * name[*], or ${!name} for the variable named by name, and then
+ * maybe an operator
+ * returns 0 for ok, 1 for a bad substitution
+ */
+{
+	struct var *itemp;
+	struct array *ap;
+	FLEXSTR	sp;
+	char	*q, *op, *val, numbuf[24];
+	int	all = 0, sub = 0, idx = 0, i, rv;
 
-	sprintf(new_string, "%s%s%s", *cmdline, lookup_value, ptr); 
-	free(*cmdline);
-	*cmdline = new_string;
+	if ( isdigit(*name) ) {			/* ${10} and on	*/
+		for ( q = name, i = 0 ; q < close && isdigit(*q) ; q++ )
+			i = i * 10 + (*q - '0');
+		if ( count ) {
+			put_value(out, i < posc ? posv[i] : NULL, 1);
+			return q != close;
+		}
+		return operate(out, i < posc ? posv[i] : "", i < posc, q, close,
+						NULL, 0);
+	}
+	if ( *name == '@' && !count ) {		/* $@ with an operator	*/
+		if ( name[1] == ':' && !is_default_op(name + 1, close) )
+			return slice(out, posv, posc, name + 2, close);
+		return each(out, posv + 1, posc - 1, name + 1, close);
+	}
+	if ( *name == '!' && name + 1 < close && is_valid_bash_variable(name + 1)
+			&& !count ) {		/* ${!ref}	*/
+		for ( q = ++name ; q < close && is_valid_bash_variable(q) ; q++ )
+			;
+		itemp = find_item_n(name, q - name);
+		val = ( itemp ? scalar_value(itemp) : "" );
+		itemp = ( *val ? find_item(val, 0) : NULL );
+		return operate(out, itemp ? scalar_value(itemp) : "",
+				itemp != NULL, q, close, NULL, 0);
+	}
+	if ( is_bash_special_char(name) && !count ) {	/* $? $$ $! $#	*/
+		fs_init(&sp, 24);
+		special_value(&sp, name);
+		val = fs_getstr(&sp);
+		rv = operate(out, val, *name != '!' || bg_pid != 0, name + 1,
+						close, NULL, 0);
+		efree(val);
+		return rv;
+	}
+	for ( q = name ; q < close && is_valid_bash_variable(q) ; q++ )
+		;
+	if ( q == name )
+		return 1;
+	op = q;
+	if ( q < close && *q == '[' ) {		/* a subscript	*/
+		if ( (op = memchr(q, ']', close - q)) == NULL || op == q + 1 )
+			return 1;
+		sub = 1;
+		if ( op - q == 2 && (q[1] == '@' || q[1] == '*') )
+			all = 1;
+		else if ( subscript(q + 1, op, &idx) == NULL )
+			return 1;
+		op++;
+	}
+	if ( count && op != close )
+		return 1;
 
-	return new_string + len + strlen(lookup_value) - 1; /* advance pointer past the lookup value */
+	itemp = find_item_n(name, q - name);
+	if ( itemp == NULL || (ap = itemp->arr) == NULL ) {
+		if ( itemp != NULL && sub && !all && idx != 0 && idx != -1 )
+			itemp = NULL;		/* a scalar is only a[0] */
+		val = ( itemp ? scalar_value(itemp) : NULL );
+		if ( all && count )
+			fs_addch(out, itemp ? '1' : '0');
+		else if ( count )
+			put_value(out, val, 1);
+		else if ( all && *op == ':' && !is_default_op(op, close) )
+			return slice(out, &val, val != NULL, op + 1, close);
+		else
+			return operate(out, val ? val : "", val != NULL, op, close,
+					sub ? NULL : name, q - name);
+		return 0;
+	}
+	if ( all && count ) {
+		snprintf(numbuf, sizeof(numbuf), "%d", ap->nset);
+		fs_addstr(out, numbuf);
+	}
+	else if ( all && *op == ':' && !is_default_op(op, close) )
+		return slice(out, ap->v, ap->n, op + 1, close);
+	else if ( all )
+		return each(out, ap->v, ap->n, op, close);
+	else if ( count )
+		put_value(out, elem(ap, idx), 1);
+	else {
+		val = elem(ap, idx);
+		return operate(out, val ? val : "", val != NULL, op, close,
+								NULL, 0);
+	}
+	return 0;
 }
 
 int VLstore( char *name, char *val )
 /*
  * traverse list, if found, replace it, else add at end
- * since there is no delete, a blank one is a free one
  * return 1 if trouble, 0 if ok (like a command)
  */
 {
 	struct var *itemp;
 	char	*s;
-	int	rv = 1;				/* assume failure	*/
 
-	/* find spot to put it              and make new string */
-	if ((itemp=find_item(name,1))!=NULL && (s=new_string(name,val))!=NULL) 
-	{
-		if ( itemp->str )		/* has a val?	*/
-			free(itemp->str);	/* y: remove it	*/
-		itemp->str = s;
-		rv = 0;				/* ok! */
+	if ( name == NULL )
+		return 1;
+	if ( (itemp = find_item(name,0)) != NULL && itemp->arr != NULL )
+		return VLsetelem(name, 0, val);		/* a=x is a[0]=x */
+	if ( itemp != NULL && itemp->isint )
+		return set_int(itemp, val);
+	if ( itemp != NULL && itemp->owned && fits(itemp, val, 0) )
+		return 0;
+	if ( (s = new_string(name,val)) == NULL )
+		return 1;
+	if ( itemp != NULL )
+		set_str(itemp, s, 1);
+	else
+		add_item(s, 0, 1);
+	return 0;
+}
+
+static int fits(struct var *itemp, char *val, int append)
+/*
+ * purpose: put val into itemp's string, after what is there if append
+ * returns: 1 if it was done, 0 if there is no room for it
+ */
+{
+	size_t	at = ( append ? itemp->len : name_len(itemp->str) + 1 ),
+		vlen = ( val == NULL ? 0 : strlen(val) );
+
+	if ( at + vlen + 1 > itemp->cap )
+		return 0;
+	memmove(itemp->str + at, val == NULL ? "" : val, vlen + 1);
+	itemp->len = at + vlen;
+	if ( itemp->global )
+		env_dirty = 1;
+	return 1;
+}
+
+int VLappend( char *name, char *val )
+/*
+ * name+=val. An integer variable adds val as an expression, an array
+ * gets val on the end of element 0. Otherwise the string is grown to
+ * twice what it needs when it is full, so building a value up a piece
+ * at a time costs amortised O(1) a char and the old value is never
+ * looked at again.
+ * return 1 if trouble, 0 if ok
+ */
+{
+	struct var *itemp = find_item(name, 0);
+	char	*s, *old;
+	int64_t	v;
+	size_t	cap;
+	int	tag, rv;
+
+	if ( itemp == NULL )
+		return VLstore(name, val);
+	if ( val == NULL )
+		val = "";
+	if ( itemp->arr != NULL ) {
+		old = ( itemp->arr->n > 0 && itemp->arr->v[0] != NULL ?
+							itemp->arr->v[0] : "" );
+		s = strcat(strcpy(emalloc(strlen(old) + strlen(val) + 1), old), val);
+		rv = VLsetelem(name, 0, s);
+		efree(s);
+		return rv;
 	}
-	return rv;
+	if ( itemp->isint ) {
+		if ( arith_eval(val, &v) != 0 )
+			return 1;
+		itemp->ival  = (int64_t)((uint64_t) itemp->ival + (uint64_t) v);
+		itemp->stale = 1;
+		if ( itemp->global )
+			env_dirty = 1;
+		return 0;
+	}
+	if ( itemp->owned && fits(itemp, val, 1) )
+		return 0;
+	cap = 2 * (itemp->len + strlen(val) + 1);
+	tag = mem_tag(MT_VARLIB);
+	s = emalloc(cap);
+	mem_tag(tag);
+	memcpy(s, itemp->str, itemp->len);
+	strcpy(s + itemp->len, val);
+	set_str(itemp, s, 1);
+	itemp->cap = cap;
+	return 0;
+}
+
+static int set_int(struct var *itemp, char *val)
+/*
+ * assign to an integer variable: val is evaluated and only the number
+ * is stored; the string waits until someone reads it
+ * returns 0 for ok, 1 if val is not a good expression
+ */
+{
+	int64_t	v;
+
+	if ( arith_eval(val == NULL ? "" : val, &v) != 0 )
+		return 1;
+	itemp->ival  = v;
+	itemp->stale = 1;
+	if ( itemp->global )
+		env_dirty = 1;
+	return 0;
+}
+
+static void fresh(struct var *itemp)
+/*
+ * write the digits of a stale integer variable into its string
+ */
+{
+	if ( itemp->stale ) {
+		snprintf(itemp->str + name_len(itemp->str) + 1, INTBUF,
+						"%" PRId64, itemp->ival);
+		itemp->stale = 0;
+	}
+}
+
+int VLsetint(char *name, int on)
+/*
+ * purpose: give name the integer attribute, or take it away
+ * returns: 0 for ok, 1 if the value so far is not a good expression
+ *          or name is an array
+ *    note: name is made if it is not there. Its string is replaced
+ *          by one with room for any number, so no write ever has to
+ *          malloc.
+ */
+{
+	struct var *itemp = find_item(name, 1);
+	int64_t	v;
+	char	*s;
+	int	tag;
+
+	if ( itemp->arr != NULL ) {
+		fprintf(stderr, "smsh: %s: an array can not be an integer\n", name);
+		return 1;
+	}
+	if ( !on || itemp->isint ) {
+		fresh(itemp);
+		itemp->isint = on;
+		itemp->len = strlen(itemp->str);
+		return 0;
+	}
+	if ( arith_eval(scalar_value(itemp), &v) != 0 )
+		return 1;
+	tag = mem_tag(MT_VARLIB);
+	s = emalloc(strlen(name) + 2 + INTBUF);
+	mem_tag(tag);
+	sprintf(s, "%s=", name);
+	set_str(itemp, s, 1);
+	itemp->isint = 1;
+	itemp->ival  = v;
+	itemp->stale = 1;
+	return 0;
+}
+
+int VLgetint(char *name, size_t len, int64_t *vp)
+/*
+ * purpose: the value of the variable named by len chars of name as
+ *          a number: an integer variable's own, else its string read
+ *          as a decimal number, 0 if it is not one
+ * returns: 1 if there is such a variable, 0 if not
+ */
+{
+	struct var *itemp = find_item_n(name, len);
+	char	*s, *end;
+	int64_t	v;
+
+	*vp = 0;
+	if ( itemp == NULL )
+		return 0;
+	if ( itemp->isint && itemp->arr == NULL )
+		*vp = itemp->ival;
+	else {
+		s = scalar_value(itemp);
+		v = strtoll(s, &end, 10);
+		if ( end != s && *end == '\0' )
+			*vp = v;
+	}
+	return 1;
+}
+
+static int in_block(struct array *ap, char *s)
+{
+	return ap->block != NULL && s >= ap->block && s < ap->block + ap->blen;
+}
+
+static void free_array(struct array *ap)
+{
+	int	i;
+
+	if ( ap == NULL )
+		return;
+	for ( i = 0 ; i < ap->n ; i++ )
+		if ( ap->v[i] != NULL && !in_block(ap, ap->v[i]) )
+			efree(ap->v[i]);
+	efree(ap->v);
+	efree(ap->block);
+	efree(ap);
+}
+
+static struct var *make_array(char *name)
+/*
+ * returns the item for name, turned into an array if it is not
+ * one. A scalar value it had becomes element 0.
+ */
+{
+	struct var *itemp = find_item(name, 0);
+	struct array *ap;
+	char	*val;
+	int	tag;
+
+	if ( itemp != NULL && itemp->arr != NULL )
+		return itemp;
+	tag = mem_tag(MT_VARLIB);
+	ap = emalloc(sizeof(struct array));
+	ap->n = ap->nset = 0;
+	ap->max = 8;
+	ap->v = emalloc(ap->max * sizeof(char *));
+	ap->block = NULL;
+	ap->blen = 0;
+	if ( itemp == NULL )
+		itemp = add_item(new_string(name, NULL), 0, 1);
+	else {
+		val = scalar_value(itemp);
+		ap->v[0] = strcpy(emalloc(strlen(val) + 1), val);
+		ap->n = ap->nset = 1;
+		set_str(itemp, new_string(name, NULL), 1);
+	}
+	mem_tag(tag);
+	itemp->arr = ap;
+	return itemp;
+}
+
+int VLsetelem(char *name, int i, char *val)
+/*
+ * name[i]=val, the array grows to take i. A negative i counts back
+ * from the end of the array.
+ * returns 0 for ok, 1 for a bad subscript
+ */
+{
+	struct array *ap = make_array(name)->arr;
+	int	tag;
+
+	if ( i < 0 && (i += ap->n) < 0 ) {
+		fprintf(stderr, "smsh: %s: bad array subscript\n", name);
+		return 1;
+	}
+	tag = mem_tag(MT_VARLIB);
+	if ( i >= ap->max ) {
+		while ( i >= ap->max )
+			ap->max *= 2;
+		ap->v = erealloc(ap->v, ap->max * sizeof(char *));
+	}
+	while ( ap->n <= i )
+		ap->v[ap->n++] = NULL;
+	if ( ap->v[i] == NULL )
+		ap->nset++;
+	else if ( !in_block(ap, ap->v[i]) )
+		efree(ap->v[i]);
+	ap->v[i] = strcpy(emalloc(strlen(val) + 1), val);
+	mem_tag(tag);
+	return 0;
+}
+
+int VLsetarray(char *name, char **v, int n, char *block, size_t blen)
+/*
+ * make name the array v[0] .. v[n-1], dropping what it held before
+ *    note: takes over v and the strings in it. Strings that point
+ *          into block are not freed on their own; block is taken
+ *          over too. block may be NULL.
+ * returns 0 for ok
+ */
+{
+	struct array *ap = make_array(name)->arr;
+	int	i;
+
+	for ( i = 0 ; i < ap->n ; i++ )
+		if ( ap->v[i] != NULL && !in_block(ap, ap->v[i]) )
+			efree(ap->v[i]);
+	efree(ap->v);
+	efree(ap->block);
+	mem_retag(v, MT_VARLIB);
+	for ( i = 0 ; i < n ; i++ )
+		if ( block == NULL || v[i] < block || v[i] >= block + blen )
+			mem_retag(v[i], MT_VARLIB);
+	if ( block != NULL )
+		mem_retag(block, MT_VARLIB);
+	ap->v = v;
+	ap->n = ap->nset = ap->max = n;
+	ap->block = block;
+	ap->blen = blen;
+	if ( ap->max == 0 ) {			/* keep v growable	*/
+		i = mem_tag(MT_VARLIB);
+		ap->v = erealloc(v, (ap->max = 8) * sizeof(char *));
+		mem_tag(i);
+	}
+	return 0;
+}
+
+static void set_str(struct var *itemp, char *s, int owned)
+/*
+ * give an item a new name=val string. The old one is freed only
+ * if we made it; strings from environ are never freed. The item is
+ * no longer an integer.
+ */
+{
+	if ( itemp->owned )
+		efree(itemp->str);
+	itemp->str = s;
+	itemp->owned = owned;
+	itemp->len = strlen(s);
+	itemp->cap = ( owned ? itemp->len + 1 : 0 );
+	itemp->isint = itemp->stale = 0;
+	if ( itemp->global )
+		env_dirty = 1;
 }
 
 char * new_string( char *name, char *val )
@@ -181,16 +1359,18 @@ char * new_string( char *name, char *val )
  */
 {
 	char	*retval;
+	int	tag = mem_tag(MT_VARLIB);
 
 	if ( name == NULL )
 		retval = NULL;
 	else if ( val == NULL )
-		retval = malloc(strlen(name)+1);
+		retval = emalloc(strlen(name)+2);
 	else
-		retval = malloc( strlen(name) + strlen(val) + 2 );
+		retval = emalloc( strlen(name) + strlen(val) + 2 );
 
 	if ( retval != NULL )
 		sprintf(retval, "%s=%s", name, (val==NULL ? "" : val) );
+	mem_tag(tag);
 	return retval;
 }
 
@@ -202,11 +1382,19 @@ char * VLlookup( char *name )
 	struct var *itemp;
 
 	if ( (itemp = find_item(name,0)) != NULL )
-		return itemp->str + 1 + strlen(name);
+		return scalar_value(itemp);
 	return "";
 
 }
 
+int VLisset( char *name )
+/*
+ * returns true if name is a variable, even an empty one
+ */
+{
+	return find_item(name,0) != NULL;
+}
+
 int VLexport( char *name )
 /*
  * marks a var for export, adds it if not there
@@ -218,6 +1406,7 @@ int VLexport( char *name )
 
 	if ( (itemp = find_item(name,0)) != NULL ){
 		itemp->global = 1;
+		env_dirty = 1;
 		rv = 0;
 	}
 	else if ( VLstore(name, "") == 0 )	/* bug fix 31 mar 08 */
@@ -225,34 +1414,162 @@ int VLexport( char *name )
 	return rv;
 }
 
+static unsigned name_hash(char *name, int len)
+{
+	unsigned h = 0;
+
+	while ( len-- > 0 )
+		h = h * 31 + (unsigned char) *name++;
+	return h;
+}
+
+static int name_len(char *str)
+/*
+ * length of the name part of a name=val string
+ */
+{
+	char	*eq = strchr(str, '=');
+
+	return ( eq ? eq - str : strlen(str) );
+}
+
+static void link_item(int i)
+/*
+ * put tab[i] on the chain for its name
+ */
+{
+	int	h = name_hash(tab[i].str, name_len(tab[i].str)) & (nbuckets-1);
+
+	tab[i].next = buckets[h];
+	buckets[h] = i;
+}
+
+static void unlink_item(int i)
+/*
+ * take tab[i] off the chain for its name
+ */
+{
+	int	*ip = &buckets[name_hash(tab[i].str, name_len(tab[i].str))
+							& (nbuckets-1)];
+
+	while ( *ip != i )
+		ip = &tab[*ip].next;
+	*ip = tab[i].next;
+}
+
+static struct var *add_item(char *str, int global, int owned)
+/*
+ * append a new name=val string to the table and index it.
+ * grows the table and rehashes as needed, so any struct var
+ * pointers held by the caller are invalid afterwards
+ */
+{
+	int	i, tag = mem_tag(MT_VARLIB);
+
+	if ( nvars == maxvars ) {
+		maxvars = maxvars ? 2 * maxvars : 64;
+		tab = erealloc(tab, maxvars * sizeof(struct var));
+	}
+	if ( nvars >= nbuckets ) {		/* keep chains short	*/
+		efree(buckets);
+		nbuckets = nbuckets ? 2 * nbuckets : 64;
+		buckets = emalloc(nbuckets * sizeof(int));
+		for ( i = 0 ; i < nbuckets ; i++ )
+			buckets[i] = -1;
+		for ( i = 0 ; i < nvars ; i++ )
+			link_item(i);
+	}
+	i = nvars++;
+	tab[i].str    = str;
+	tab[i].global = global;
+	tab[i].owned  = owned;
+	tab[i].arr    = NULL;
+	tab[i].isint  = tab[i].stale = 0;
+	tab[i].ival   = 0;
+	tab[i].len    = strlen(str);
+	tab[i].cap    = ( owned ? tab[i].len + 1 : 0 );
+	link_item(i);
+	mem_tag(tag);
+	return &tab[i];
+}
+
+static void load_env()
+/*
+ * enter the inherited environment in the table. The strings are
+ * used where they are; nothing is copied.
+ */
+{
+	char	**env = env_src;
+
+	env_src = NULL;
+	for ( ; *env != NULL ; env++ )
+		if ( strchr(*env, '=') != NULL )
+			add_item(*env, 1, 0);
+}
+
 static struct var * find_item( char *name , int first_blank )
 /*
  * searches table for an item
  * returns ptr to struct or NULL if not found
- * OR if (first_blank) then ptr to first blank one
+ * OR if (first_blank) then ptr to a new blank one
  */
 {
-	int	i;
-	int	len ;
-	char	*s;
+	struct var *itemp;
 
 	if ( name == NULL )
 		return NULL;
+	itemp = find_item_n(name, strlen(name));
+	if ( itemp == NULL && first_blank )
+		itemp = add_item(new_string(name, NULL), 0, 1);
+	return itemp;
+}
 
-	len = strlen(name);
+static struct var * find_item_n( char *name, int len )
+/*
+ * find_item for a name that is the first len chars of name
+ */
+{
+	int	i;
+	char	*s;
+
+	if ( env_src != NULL )		/* first lookup: index environ */
+		load_env();
+	if ( nbuckets == 0 )
+		return NULL;
 
-	for( i = 0 ; i<MAXVARS && tab[i].str != NULL ; i++ )
+	for( i = buckets[name_hash(name, len) & (nbuckets-1)] ; i != -1 ;
+							i = tab[i].next )
 	{
 		s = tab[i].str;
 		if ( strncmp(s,name,len) == 0 && s[len] == '=' ){
 			return &tab[i];
 		}
 	}
-	if ( i < MAXVARS && first_blank )
-		return &tab[i];
 	return NULL;
 }
 
+static void drop_item(struct var *itemp)
+/*
+ * removes an item from the table. The last item is moved into
+ * the hole so the table stays packed.
+ */
+{
+	int	i = itemp - tab;
+	int	last = nvars - 1;
+
+	if ( itemp->global )
+		env_dirty = 1;
+	unlink_item(i);
+	if ( itemp->owned )
+		efree(itemp->str);
+	free_array(itemp->arr);
+	if ( i != last ) {
+		unlink_item(last);
+		tab[i] = tab[last];
+		link_item(i);
+	}
+	nvars--;
+}
 
 void VLlist()
 /*
@@ -261,10 +1578,21 @@ void VLlist()
  * exported variable with the symbol  '*' 
  */
 {
-	int	i;
-	for(i = 0 ; i<MAXVARS && tab[i].str != NULL ; i++ )
+	int	i, j;
+
+	if ( env_src != NULL )
+		load_env();
+	for(i = 0 ; i < nvars ; i++ )
 	{
-		if ( tab[i].global )
+		fresh(&tab[i]);
+		if ( tab[i].arr != NULL ) {
+			printf("    %s(", tab[i].str);
+			for ( j = 0 ; j < tab[i].arr->n ; j++ )
+				if ( tab[i].arr->v[j] != NULL )
+					printf(" [%d]=%s", j, tab[i].arr->v[j]);
+			printf(" )\n");
+		}
+		else if ( tab[i].global )
 			printf("  * %s\n", tab[i].str);
 		else
 			printf("    %s\n", tab[i].str);
@@ -273,35 +1601,21 @@ void VLlist()
 
 int VLenviron2table(char *env[])
 /*
- * initialize the variable table by loading array of strings
+ * initialize the variable table from an array of strings. Nothing
+ * is read or copied here, the first lookup loads the table
  * return 1 for ok, 0 for not ok
  */
 {
-	int     i;
-	char	*newstring;
-
-	for(i = 0 ; env[i] != NULL ; i++ )
-	{
-		if ( i == MAXVARS )
-			return 0;
-		newstring = malloc(1+strlen(env[i]));
-		if ( newstring == NULL )
-			return 0;
-		strcpy(newstring, env[i]);
-		tab[i].str = newstring;
-		tab[i].global = 1;
-	}
-	while( i < MAXVARS ){		/* I know we don't need this	*/
-		tab[i].str = NULL ;	/* static globals are nulled	*/
-		tab[i++].global = 0;	/* by default			*/
-	}
+	env_src = env_orig = env;
+	env_dirty = 0;
 	return 1;
 }
 
 char ** VLtable2environ()
 /*
  * build an array of pointers suitable for making a new environment
- * note, you need to free() this when done to avoid memory leaks
+ * if no exported variable changed this is the inherited environ.
+ * note, otherwise you need to efree() this when done to avoid leaks
  */
 {
 	int	i,			/* index			*/
@@ -309,23 +1623,28 @@ char ** VLtable2environ()
 		n = 0;			/* counter			*/
 	char	**envtab;		/* array of pointers		*/
 
+	if ( !env_dirty && env_orig != NULL )
+		return env_orig;
+
 	/*
 	 * first, count the number of global variables
 	 */
 
-	for( i = 0 ; i<MAXVARS && tab[i].str != NULL ; i++ )
-		if ( tab[i].global == 1 )
+	for( i = 0 ; i < nvars ; i++ )
+		if ( tab[i].global == 1 && tab[i].arr == NULL )
 			n++;
 
 	/* then, allocate space for that many variables	*/
-	envtab = (char **) malloc( (n+1) * sizeof(char *) );
-	if ( envtab == NULL )
-		return NULL;
+	i = mem_tag(MT_VARLIB);
+	envtab = (char **) emalloc( (n+1) * sizeof(char *) );
+	mem_tag(i);
 
 	/* then, load the array with pointers		*/
-	for(i = 0, j = 0 ; i<MAXVARS && tab[i].str != NULL ; i++ )
-		if ( tab[i].global == 1 )
+	for(i = 0, j = 0 ; i < nvars ; i++ )
+		if ( tab[i].global == 1 && tab[i].arr == NULL ) {
+			fresh(&tab[i]);
 			envtab[j++] = tab[i].str;
+		}
 	envtab[j] = NULL;
 	return envtab;
 }
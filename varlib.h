@@ -1,15 +1,35 @@
 #ifndef	VARLIB_H
 #define	VARLIB_H
+
+#include	<stddef.h>
+#include	<stdint.h>
 /*
  * header for varlib.c package
  */
 
 int	VLexport(char *);
 char	*VLlookup(char *);
+int	VLisset(char *);
 void	VLlist();
 int	VLstore( char *, char * );
+int	VLappend( char *, char * );
 char	**VLtable2environ();
 int	VLenviron2table(char **);
-char *substitute_variables(char **);
+char *substitute_variables(char *, size_t);
+
+void	VLinit();
+void	VLsetstatus(int);
+int	VLstatus();
+void	VLsetbgpid(int);
+void	VLsetargs(int, char **);
+int	VLshift(int);
+void	VLgetargs(int *, char ***);
+void	VLpushscope();
+void	VLpopscope();
+int	VLlocal(char *, char *);
+int	VLsetelem(char *, int, char *);
+int	VLsetarray(char *, char **, int, char *, size_t);
+int	VLsetint(char *, int);
+int	VLgetint(char *, size_t, int64_t *);
 
 #endif
@@ -0,0 +1,329 @@
+/* wildcard.c - pathname expansion for smsh
+ *
+ *    glob_words(args)     expand the words of a split line that have
+ *                         * ? or [...] in them into the sorted list
+ *                         of paths they match
+ *    glob_flush()         drop the directory cache, called when a
+ *                         command line is done
+ *
+ *  a pattern that matches nothing is left as it is. Names starting
+ *  with . only match a pattern that starts with a . too. A command
+ *  that is an assignment, x=* or a[1]=y, is not expanded, nor are the
+ *  words of a [[ ... ]], which has patterns of its own.
+ *
+ *  directories are read with getdents64 on a descriptor from openat
+ *  and each listing is kept, sorted, until the command line is done.
+ *  A listing is found again by device and inode, and is only used if
+ *  the directory's mtime has not changed since it was read, so globs
+ *  over the same directories in one command line cost one stat each.
+ *
+ *  substitute_variables leaves the \ in front of an escaped * ? [ or
+ *  \ so that those are not taken as wildcards here; the escapes are
+ *  removed from every word that goes through this stage.
+ */
+
+#define	_GNU_SOURCE
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<ctype.h>
+#include	<stdint.h>
+#include	<fcntl.h>
+#include	<dirent.h>
+#include	<unistd.h>
+#include	<sys/stat.h>
+#include	<sys/syscall.h>
+
+#include	"smsh.h"
+#include	"splitline.h"
+#include	"flexstr.h"
+#include	"match.h"
+#include	"wildcard.h"
+
+struct dent {
+		char	*name;
+		unsigned char type;	/* d_type, may be DT_UNKNOWN */
+	};
+
+struct dirlist {
+		dev_t	dev;
+		ino_t	ino;
+		struct timespec mtime;	/* when it was read	*/
+		int	n;
+		struct dent *ents;	/* sorted by name	*/
+		char	*block;		/* the name strings	*/
+		struct dirlist *next;
+	};
+
+struct linux_dirent64 {			/* what getdents64 returns */
+		uint64_t d_ino;		/* 64 bits on every arch	*/
+		int64_t	d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char	d_name[];
+	};
+
+#define	DENTBUF	32768
+
+static struct dirlist *cache = NULL;
+
+static void	glob_path(char *, char *, FLEXLIST *);
+static struct dirlist *read_dir(char *);
+
+static int cmpstr(const void *a, const void *b)
+{
+	return strcmp(*(char **) a, *(char **) b);
+}
+
+static int cmpdent(const void *a, const void *b)
+{
+	return strcmp(((struct dent *) a)->name, ((struct dent *) b)->name);
+}
+
+static void free_dirlist(struct dirlist *dp)
+{
+	efree(dp->ents);
+	efree(dp->block);
+	efree(dp);
+}
+
+static char *unescape(char *s, int n)
+/*
+ * copy of the first n chars of s with the \ escapes removed
+ */
+{
+	char	*rv = emalloc(n + 1), *dp = rv;
+	char	*end = s + n;
+
+	for ( ; s < end ; s++ ) {
+		if ( *s == '\\' && s + 1 < end )
+			s++;
+		*dp++ = *s;
+	}
+	*dp = '\0';
+	return rv;
+}
+
+static int is_assignment(char *w)
+/*
+ * name=... or name[...]=...
+ */
+{
+	char	*eq = strchr(w, '=');
+
+	if ( eq == NULL || eq == w || isdigit(*w) )
+		return 0;
+	for ( ; w < eq && (isalnum(*w) || *w == '_') ; w++ )
+		;
+	return w == eq || (*w == '[' && eq[-1] == ']' && eq - w > 2);
+}
+
+char **glob_words(char **args)
+/*
+ * purpose: pathname expansion on a split command line
+ * returns: args if no word needed work, otherwise a new list.
+ *          the old list and the words that were replaced are freed.
+ */
+{
+	FLEXLIST out;
+	char	**wp;
+	int	before, tag, cond = args[0] != NULL && strcmp(args[0], "[[") == 0;
+
+	for ( wp = args ; *wp != NULL ; wp++ )
+		if ( strpbrk(*wp, "*?[\\") != NULL )
+			break;
+	if ( *wp == NULL )			/* the usual case	*/
+		return args;
+
+	tag = mem_tag(MT_EXPAND);
+	fl_init(&out, 0);
+	for ( wp = args ; *wp != NULL ; wp++ ) {
+		if ( strpbrk(*wp, "*?[\\") == NULL ) {
+			fl_append(&out, *wp);		/* hand it over	*/
+			continue;
+		}
+		before = fl_getcount(&out);
+		if ( has_wildcards(*wp) && !cond
+				&& !(wp == args && is_assignment(*wp)) ) {
+			if ( (*wp)[0] == '/' )
+				glob_path("/", *wp + 1, &out);
+			else
+				glob_path("", *wp, &out);
+			if ( fl_getcount(&out) - before > 1 )
+				qsort(fl_getlist(&out) + before, fl_getcount(&out)
+					- before, sizeof(char *), cmpstr);
+		}
+		if ( fl_getcount(&out) == before )	/* no match	*/
+			fl_append(&out, unescape(*wp, strlen(*wp)));
+		efree(*wp);
+	}
+	fl_append(&out, NULL);
+	efree(args);
+	mem_tag(tag);
+	return fl_getlist(&out);
+}
+
+static void glob_path(char *dir, char *pat, FLEXLIST *out)
+/*
+ * purpose: add to out the paths under dir that match pat
+ *    args: dir is "" or ends in a /, pat is the rest of the pattern
+ *  method: take the first component of pat. With no wildcards in it
+ *          it is just added to dir. Otherwise the listing of dir is
+ *          matched against it. Then go on with the rest.
+ */
+{
+	char	*slash, *comp, *path, *rest;
+	struct dirlist *dp;
+	struct stat info;
+	int	complen, i, isdir;
+
+	while ( *pat == '/' )
+		pat++;
+	slash = strchr(pat, '/');
+	complen = ( slash ? slash - pat : (int) strlen(pat) );
+	rest = ( slash ? slash : NULL );
+
+	comp = emalloc(complen + 1);
+	memcpy(comp, pat, complen);
+	comp[complen] = '\0';
+
+	if ( !has_wildcards(comp) ) {
+		path = emalloc(strlen(dir) + complen + 2);
+		strcpy(path, dir);
+		efree(comp);
+		comp = unescape(pat, complen);
+		strcat(path, comp);
+		if ( rest == NULL || rest[1] == '\0' ) {	/* last one	*/
+			if ( lstat(path, &info) == 0 &&
+			     (rest == NULL || S_ISDIR(info.st_mode)) ) {
+				if ( rest != NULL )
+					strcat(path, "/");
+				fl_append(out, path);
+				path = NULL;
+			}
+		}
+		else {
+			strcat(path, "/");
+			glob_path(path, rest, out);
+		}
+		efree(path);
+		efree(comp);
+		return;
+	}
+
+	if ( (dp = read_dir(dir[0] ? dir : ".")) != NULL ) {
+		for ( i = 0 ; i < dp->n ; i++ ) {
+			if ( dp->ents[i].name[0] == '.' && comp[0] != '.' )
+				continue;
+			if ( !pmatch(comp, dp->ents[i].name) )
+				continue;
+			path = emalloc(strlen(dir) + strlen(dp->ents[i].name) + 2);
+			sprintf(path, "%s%s", dir, dp->ents[i].name);
+			isdir = ( dp->ents[i].type == DT_DIR );
+			if ( rest != NULL && (dp->ents[i].type == DT_UNKNOWN ||
+						dp->ents[i].type == DT_LNK) )
+				isdir = ( stat(path, &info) == 0 &&
+						S_ISDIR(info.st_mode) );
+			if ( rest == NULL ) {
+				fl_append(out, path);
+				continue;
+			}
+			if ( isdir ) {
+				strcat(path, "/");
+				if ( rest[1] == '\0' )		/* pat/ */
+					fl_append(out, path);
+				else {
+					glob_path(path, rest, out);
+					efree(path);
+				}
+				continue;
+			}
+			efree(path);
+		}
+	}
+	efree(comp);
+}
+
+static struct dirlist *read_dir(char *dir)
+/*
+ * purpose: get the sorted listing of a directory
+ * returns: the cached listing if the directory has not changed,
+ *          a fresh one otherwise, NULL if it cannot be read
+ */
+{
+	struct dirlist *dp, **dpp;
+	struct linux_dirent64 *de;
+	struct stat info;
+	FLEXSTR	names;
+	char	*buf;
+	long	nread, off;
+	size_t	*offsets = NULL;
+	int	fd, i, max = 0;
+
+	if ( stat(dir, &info) == -1 || !S_ISDIR(info.st_mode) )
+		return NULL;
+	for ( dpp = &cache ; (dp = *dpp) != NULL ; dpp = &dp->next )
+		if ( dp->dev == info.st_dev && dp->ino == info.st_ino ) {
+			if ( dp->mtime.tv_sec == info.st_mtim.tv_sec &&
+			     dp->mtime.tv_nsec == info.st_mtim.tv_nsec )
+				return dp;
+			*dpp = dp->next;		/* stale	*/
+			free_dirlist(dp);
+			break;
+		}
+
+	if ( (fd = openat(AT_FDCWD, dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) == -1 )
+		return NULL;
+	fs_init(&names, 4096);
+	buf = emalloc(DENTBUF);
+	dp = emalloc(sizeof(struct dirlist));
+	dp->n = 0;
+	dp->ents = NULL;
+	while ( (nread = syscall(SYS_getdents64, fd, buf, DENTBUF)) > 0 ) {
+		for ( off = 0 ; off < nread ; off += de->d_reclen ) {
+			de = (struct linux_dirent64 *) (buf + off);
+			if ( strcmp(de->d_name, ".") == 0 ||
+			     strcmp(de->d_name, "..") == 0 )
+				continue;
+			if ( dp->n == max ) {
+				max = max ? 2 * max : 64;
+				dp->ents = erealloc(dp->ents, max * sizeof(struct dent));
+				offsets = erealloc(offsets, max * sizeof(size_t));
+			}
+			dp->ents[dp->n].type = de->d_type;
+			offsets[dp->n++] = names.fs_used;	/* block moves */
+			fs_addstr(&names, de->d_name);
+			fs_addch(&names, '\0');
+		}
+	}
+	close(fd);
+	efree(buf);
+
+	dp->block = fs_getstr(&names);
+	for ( i = 0 ; i < dp->n ; i++ )
+		dp->ents[i].name = dp->block + offsets[i];
+	efree(offsets);
+	qsort(dp->ents, dp->n, sizeof(struct dent), cmpdent);
+
+	dp->dev   = info.st_dev;
+	dp->ino   = info.st_ino;
+	dp->mtime = info.st_mtim;
+	dp->next  = cache;
+	cache = dp;
+	return dp;
+}
+
+void glob_flush()
+/*
+ * forget all directory listings
+ */
+{
+	struct dirlist *dp;
+	int	tag = mem_tag(MT_EXPAND);
+
+	while ( (dp = cache) != NULL ) {
+		cache = dp->next;
+		free_dirlist(dp);
+	}
+	mem_tag(tag);
+}
@@ -0,0 +1,10 @@
+#ifndef	WILDCARD_H
+#define	WILDCARD_H
+/*
+ * header for wildcard.c - pathname expansion
+ */
+
+char	**glob_words(char **);
+void	glob_flush();
+
+#endif